@@ -8,6 +8,7 @@
       'type': 'none',
       'dependencies': [
         'chksound/chksound.gyp:chksound',
+        'chksound/chksound.gyp:chksound_bench',
         'third_party/lib1770-2/lib1770.gyp:lib1770-2',
       ],
     },
@@ -0,0 +1,321 @@
+// Copyright (c) 2026 dacci.org
+
+#include "app/analysis_cache.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <system_error>  // NOLINT(build/c++11)
+#include <utility>
+
+namespace fs = ::std::filesystem;
+
+namespace chksound::app {
+namespace {
+
+// Records are stored in native byte order after this signature. The last two
+// characters are the version, bumped whenever the analysis results change.
+constexpr char kSignature[8] = {'C', 'H', 'K', 'S', 'N', 'D', '0', '7'};
+constexpr size_t kVersionOffset = 6;
+
+template <class T>
+bool ReadValue(std::istream* stream, T* value) {
+  return static_cast<bool>(
+      stream->read(reinterpret_cast<char*>(value), sizeof(*value)));
+}
+
+template <class T>
+void WriteValue(std::ostream* stream, const T& value) {
+  stream->write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Returns true if |path| is a cache of another version, which is started over
+// rather than rejected.
+bool IsOtherVersion(const fs::path& path) {
+  std::ifstream stream(path, std::ios::binary);
+  char signature[sizeof(kSignature)];
+  return stream.read(signature, sizeof(signature)) &&
+         memcmp(signature, kSignature, kVersionOffset) == 0 &&
+         memcmp(signature, kSignature, sizeof(kSignature)) != 0;
+}
+
+bool ReadRecord(std::istream* stream, AnalysisCache::Record* record) {
+  auto& histogram = record->histogram;
+  uint32_t bins;
+  if (!ReadValue(stream, &record->loudness) ||
+      !ReadValue(stream, &record->peak) ||
+      !ReadValue(stream, &record->true_peak) ||
+      !ReadValue(stream, &record->loudness_range) ||
+      !ReadValue(stream, &record->max_momentary) ||
+      !ReadValue(stream, &record->max_short_term) ||
+      !ReadValue(stream, &histogram.mean) ||
+      !ReadValue(stream, &histogram.count) ||
+      !ReadValue(stream, &histogram.max) || !ReadValue(stream, &bins) ||
+      LIB1770_HIST_NBINS < bins)
+    return false;
+
+  histogram.bins.resize(bins);
+  for (auto& bin : histogram.bins) {
+    if (!ReadValue(stream, &bin.first) || !ReadValue(stream, &bin.second))
+      return false;
+  }
+
+  return true;
+}
+
+void WriteRecord(std::ostream* stream, const AnalysisCache::Record& record) {
+  auto& histogram = record.histogram;
+  WriteValue(stream, record.loudness);
+  WriteValue(stream, record.peak);
+  WriteValue(stream, record.true_peak);
+  WriteValue(stream, record.loudness_range);
+  WriteValue(stream, record.max_momentary);
+  WriteValue(stream, record.max_short_term);
+  WriteValue(stream, histogram.mean);
+  WriteValue(stream, histogram.count);
+  WriteValue(stream, histogram.max);
+  WriteValue(stream, static_cast<uint32_t>(histogram.bins.size()));
+  for (auto& bin : histogram.bins) {
+    WriteValue(stream, bin.first);
+    WriteValue(stream, bin.second);
+  }
+}
+
+// Returns the bytes of an entry of the file, and the offset of its record in
+// them in |offset|.
+std::string FormatEntry(const std::string& key, uint64_t size, int64_t time,
+                        const AnalysisCache::Record& record,
+                        uint64_t* offset) {
+  std::ostringstream buffer;
+  WriteValue(&buffer, static_cast<uint32_t>(key.size()));
+  buffer.write(key.data(), key.size());
+  WriteValue(&buffer, size);
+  WriteValue(&buffer, time);
+  *offset = buffer.tellp();
+  WriteRecord(&buffer, record);
+
+  return buffer.str();
+}
+
+}  // namespace
+
+AnalysisCache::~AnalysisCache() = default;
+
+std::unique_ptr<AnalysisCache> AnalysisCache::Open(const fs::path& path) {
+  struct Bridge : AnalysisCache {};
+  auto cache = std::make_unique<Bridge>();
+
+  std::error_code error;
+  if (fs::exists(path, error) && !IsOtherVersion(path)) {
+    auto size = fs::file_size(path, error);
+    cache->reader_.open(path, std::ios::binary);
+    if (error || !cache->reader_ || !cache->Load(size)) {
+      std::cerr << "invalid cache: " << path << std::endl;
+      return nullptr;
+    }
+
+    // The file is rewritten once the records superseded by later ones
+    // outnumber the others. Either way, the reader is closed first, as
+    // Windows requires.
+    auto live = cache->items_.size();
+    if (cache->records_ - live <= live || !cache->Compact(path)) {
+      cache->reader_.close();
+
+      // Drop a record cut short by an interrupted run before appending.
+      if (cache->length_ < size)
+        fs::resize_file(path, cache->length_, error);
+    }
+
+    cache->reader_.open(path, std::ios::binary);
+    cache->writer_.open(path, std::ios::binary | std::ios::app);
+  } else {
+    cache->writer_.open(path, std::ios::binary | std::ios::trunc);
+    cache->writer_.write(kSignature, sizeof(kSignature));
+    cache->writer_.flush();
+    cache->length_ = sizeof(kSignature);
+    cache->reader_.open(path, std::ios::binary);
+  }
+
+  if (!cache->writer_ || !cache->reader_) {
+    std::cerr << "failed to open cache: " << path << std::endl;
+    return nullptr;
+  }
+
+  return cache;
+}
+
+bool AnalysisCache::Find(const fs::path& path, Record* record) {
+  Identity identity;
+  if (!GetIdentity(path, &identity))
+    return false;
+
+  std::scoped_lock<std::mutex> lock(mutex_);
+
+  auto found = items_.find(GetKey(path));
+  if (found == items_.end())
+    return false;
+
+  auto& item = found->second;
+  if (item.identity.size != identity.size ||
+      item.identity.time != identity.time)
+    return false;
+
+  return Read(item.offset, record);
+}
+
+void AnalysisCache::Store(const fs::path& path, const Record& record) {
+  Identity identity;
+  if (!GetIdentity(path, &identity))
+    return;
+
+  auto key = GetKey(path);
+
+  std::scoped_lock<std::mutex> lock(mutex_);
+  Write(key, identity, record);
+}
+
+void AnalysisCache::Refresh(const fs::path& path) {
+  Identity identity;
+  if (!GetIdentity(path, &identity))
+    return;
+
+  auto key = GetKey(path);
+
+  std::scoped_lock<std::mutex> lock(mutex_);
+
+  auto found = items_.find(key);
+  if (found == items_.end())
+    return;
+
+  Record record;
+  if (Read(found->second.offset, &record))
+    Write(key, identity, record);
+}
+
+AnalysisCache::AnalysisCache() : length_{}, records_{} {}
+
+bool AnalysisCache::Load(uint64_t size) {
+  char signature[sizeof(kSignature)];
+  if (!reader_.read(signature, sizeof(signature)) ||
+      memcmp(signature, kSignature, sizeof(kSignature)) != 0)
+    return false;
+
+  length_ = sizeof(kSignature);
+
+  // A record cut short by an interrupted run ends the log.
+  Record record;
+  for (uint32_t key_size; ReadValue(&reader_, &key_size);) {
+    if (size - static_cast<uint64_t>(reader_.tellg()) < key_size)
+      break;
+
+    std::string key(key_size, '\0');
+    if (!reader_.read(key.data(), key_size))
+      break;
+
+    Item item;
+    if (!ReadValue(&reader_, &item.identity.size) ||
+        !ReadValue(&reader_, &item.identity.time))
+      break;
+
+    item.offset = reader_.tellg();
+    if (!ReadRecord(&reader_, &record))
+      break;
+
+    items_.insert_or_assign(std::move(key), item);
+    length_ = reader_.tellg();
+    ++records_;
+  }
+
+  reader_.clear();
+  return true;
+}
+
+bool AnalysisCache::Compact(const fs::path& path) {
+  auto temporary = path;
+  temporary += ".tmp";
+
+  std::ofstream writer(temporary, std::ios::binary | std::ios::trunc);
+  writer.write(kSignature, sizeof(kSignature));
+
+  std::unordered_map<std::string, Item> items;
+  uint64_t length = sizeof(kSignature);
+  Record record;
+  for (auto& [key, item] : items_) {
+    if (!Read(item.offset, &record))
+      break;
+
+    uint64_t offset;
+    auto data = FormatEntry(key, item.identity.size, item.identity.time,
+                            record, &offset);
+    if (!writer.write(data.data(), data.size()))
+      break;
+
+    items.insert_or_assign(key, Item{item.identity, length + offset});
+    length += data.size();
+  }
+
+  std::error_code error;
+  writer.close();
+  if (!writer || items.size() != items_.size()) {
+    fs::remove(temporary, error);
+    return false;
+  }
+
+  reader_.close();
+  fs::rename(temporary, path, error);
+  if (error) {
+    fs::remove(temporary, error);
+    return false;
+  }
+
+  items_.swap(items);
+  length_ = length;
+  records_ = items_.size();
+  return true;
+}
+
+bool AnalysisCache::Read(uint64_t offset, Record* record) {
+  reader_.clear();
+  if (!reader_.seekg(offset))
+    return false;
+
+  return ReadRecord(&reader_, record);
+}
+
+void AnalysisCache::Write(const std::string& key, const Identity& identity,
+                          const Record& record) {
+  uint64_t offset;
+  auto data = FormatEntry(key, identity.size, identity.time, record, &offset);
+  if (!writer_.write(data.data(), data.size()).flush())
+    return;
+
+  items_.insert_or_assign(key, Item{identity, length_ + offset});
+  length_ += data.size();
+  ++records_;
+}
+
+std::string AnalysisCache::GetKey(const fs::path& path) {
+  std::error_code error;
+  auto absolute = fs::absolute(path, error);
+  if (error)
+    return path.lexically_normal().u8string();
+
+  return absolute.lexically_normal().u8string();
+}
+
+bool AnalysisCache::GetIdentity(const fs::path& path, Identity* identity) {
+  std::error_code error;
+  auto size = fs::file_size(path, error);
+  if (error)
+    return false;
+
+  auto time = fs::last_write_time(path, error);
+  if (error)
+    return false;
+
+  identity->size = size;
+  identity->time = time.time_since_epoch().count();
+  return true;
+}
+
+}  // namespace chksound::app
@@ -0,0 +1,85 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_APP_ANALYSIS_CACHE_H_
+#define CHKSOUND_APP_ANALYSIS_CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <unordered_map>
+
+#include "audio/gain_analysis.h"
+
+namespace chksound::app {
+
+// Persistent store of analysis results keyed by the path of the analyzed file
+// and validated against its size and modification time. Records are appended
+// to the cache file as soon as they are stored, so the results of an
+// interrupted run are not lost. Only an index is kept in memory; records are
+// read back from the file when they are looked up. The records superseded by
+// later ones are dropped when the file is opened, once they outnumber the
+// others.
+class AnalysisCache {
+ public:
+  struct Record {
+    double loudness;
+    double peak;
+    double true_peak;       // negative if not measured.
+    double loudness_range;  // negative if not measured.
+    double max_momentary;
+    double max_short_term;
+    audio::GainHistogram histogram;
+  };
+
+  ~AnalysisCache();
+
+  static std::unique_ptr<AnalysisCache> Open(
+      const std::filesystem::path& path);
+
+  bool Find(const std::filesystem::path& path, Record* record);
+  void Store(const std::filesystem::path& path, const Record& record);
+
+  // Revalidates the record of |path| after its tags have been rewritten, which
+  // changes the identity of the file but not its audio.
+  void Refresh(const std::filesystem::path& path);
+
+ private:
+  struct Identity {
+    uint64_t size;
+    int64_t time;
+  };
+
+  struct Item {
+    Identity identity;
+    uint64_t offset;  // of the record in the file.
+  };
+
+  AnalysisCache();
+
+  bool Load(uint64_t size);
+  bool Compact(const std::filesystem::path& path);
+  bool Read(uint64_t offset, Record* record);
+  void Write(const std::string& key, const Identity& identity,
+             const Record& record);
+
+  static std::string GetKey(const std::filesystem::path& path);
+  static bool GetIdentity(const std::filesystem::path& path,
+                          Identity* identity);
+
+  std::mutex mutex_;
+  std::ifstream reader_;
+  std::ofstream writer_;
+  uint64_t length_;
+  uint64_t records_;  // in the file, including those superseded.
+  std::unordered_map<std::string, Item> items_;
+
+  AnalysisCache(const AnalysisCache&) = delete;
+  AnalysisCache& operator=(const AnalysisCache&) = delete;
+};
+
+}  // namespace chksound::app
+
+#endif  // CHKSOUND_APP_ANALYSIS_CACHE_H_
@@ -3,23 +3,28 @@
 #include "app/analyzer.h"
 
 #include <taglib/commentsframe.h>
+#include <taglib/id3v2framefactory.h>
 #include <taglib/id3v2tag.h>
 #include <taglib/mp4file.h>
 #include <taglib/mpegfile.h>
+#include <taglib/textidentificationframe.h>
+#include <taglib/tfilestream.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
 #include <iomanip>
+#include <iostream>
 #include <sstream>
 #include <utility>
 
-#ifdef __cpp_lib_execution
-#include <execution>
-#else
-#include <thread>  // NOLINT(build/c++11)
-#endif
-
+#include "app/analysis_cache.h"
+#include "app/report.h"
 #include "audio/audio_reader.h"
 #include "audio/gain_analysis.h"
+#include "util/profiler.h"
+#include "util/thread_pool.h"
 
 #ifdef _MSC_VER
 #define wcscasecmp _wcsicmp
@@ -34,103 +39,436 @@ const auto kMP3 = new fs::path(".mp3");
 const auto kM4A = new fs::path(".m4a");
 const auto kTCMP = new TagLib::ByteVector("TCMP");
 const auto kCPIL = new TagLib::ByteVector("cpil");
+const auto kNormalization =
+    new TagLib::String("----:com.apple.iTunes:iTunNORM");
+
+// Tags written besides iTunNORM on request, as TXXX frames of ID3v2 and as
+// freeform items of MP4.
+constexpr char kFreeformPrefix[] = "----:com.apple.iTunes:";
+constexpr char kTrackGain[] = "REPLAYGAIN_TRACK_GAIN";
+constexpr char kTrackPeak[] = "REPLAYGAIN_TRACK_PEAK";
+constexpr char kAlbumGain[] = "REPLAYGAIN_ALBUM_GAIN";
+constexpr char kAlbumPeak[] = "REPLAYGAIN_ALBUM_PEAK";
+constexpr char kR128TrackGain[] = "R128_TRACK_GAIN";
+constexpr char kR128AlbumGain[] = "R128_ALBUM_GAIN";
+constexpr const char* kReplayGainKeys[] = {kTrackGain, kTrackPeak, kAlbumGain,
+                                           kAlbumPeak};
+constexpr const char* kR128Keys[] = {kR128TrackGain, kR128AlbumGain};
+
+constexpr size_t kFramesPerRead = 4096;
+
+// Maximum number of files kept open between their analysis and commit.
+constexpr size_t kMaxOpenStreams = 256;
+
+// Difference in dB between the stored and the approximate gain above which a
+// file is listed by the fast mode.
+constexpr double kScreenTolerance = 1.0;
+
+// Tracks at least twice this long are split into segments of about this
+// length, which are analyzed in parallel.
+constexpr double kSegmentSeconds = 300.0;
+
+// Length of the stream preceding a segment which is run through the filters
+// to settle them before the segment is measured.
+constexpr double kWarmUpSeconds = 0.5;
 
 int GetAdjustment(double gain, double base) {
   return static_cast<int>(
       std::min(round(pow(10.0, -gain / 10.0) * base), 65534.0));
 }
 
+double GetGain(int adjustment, double base) {
+  return -10.0 * log10(adjustment / base);
+}
+
+std::string FormatDecimal(double value, int precision) {
+  std::ostringstream buffer;
+  buffer << std::fixed << std::setprecision(precision) << value;
+  return buffer.str();
+}
+
+// Returns the group key with a tab between the artist and the album.
+std::string GetReportGroup(std::string key) {
+  std::replace(key.begin(), key.end(), '\0', '\t');
+  return key;
+}
+
+// R128 gains are relative to -23 LUFS, in 1/256 dB.
+std::string FormatR128Gain(double loudness) {
+  auto gain = round((-23.0 - loudness) * 256.0);
+  return std::to_string(
+      static_cast<int>(std::clamp(gain, -32768.0, 32767.0)));
+}
+
+TagLib::ID3v2::CommentsFrame* FindNormalization(TagLib::ID3v2::Tag* tag) {
+  for (auto f : tag->frameList("COMM")) {
+    auto frame = static_cast<TagLib::ID3v2::CommentsFrame*>(f);
+    if (wcscasecmp(frame->description().toCWString(), L"iTunNORM") == 0)
+      return frame;
+  }
+
+  return nullptr;
+}
+
+// Other tools write the ReplayGain tags in lower case as well.
+TagLib::ID3v2::UserTextIdentificationFrame* FindUserText(
+    TagLib::ID3v2::Tag* tag, const TagLib::String& description) {
+  for (auto f : tag->frameList("TXXX")) {
+    auto frame = static_cast<TagLib::ID3v2::UserTextIdentificationFrame*>(f);
+    if (wcscasecmp(frame->description().toCWString(),
+                   description.toCWString()) == 0)
+      return frame;
+  }
+
+  return nullptr;
+}
+
+// Feeds up to |frames| frames read from |reader| to |analysis|, or only
+// primes its filters with them if |prime| is true. Returns the number of
+// frames read. The time spent decoding and filtering is added to |profiler|
+// unless it is null.
+uint64_t Feed(audio::AudioReader* reader, audio::GainAnalysis* analysis,
+              uint64_t frames, bool prime, util::Profiler* profiler) {
+  using Clock = util::Profiler::Clock;
+
+  std::vector<double> buffer(kFramesPerRead * reader->GetChannels());
+  uint64_t total = 0;
+  uint64_t reads = 0;
+  Clock::duration decode{};
+  Clock::duration filter{};
+  while (total < frames) {
+    Clock::time_point start;
+    if (profiler != nullptr)
+      start = Clock::now();
+
+    auto count = reader->Read(
+        buffer.data(), std::min<uint64_t>(frames - total, kFramesPerRead));
+    ++reads;
+
+    Clock::time_point read;
+    if (profiler != nullptr) {
+      read = Clock::now();
+      decode += read - start;
+    }
+
+    if (count == 0)
+      break;
+
+    if (prime)
+      analysis->Prime(buffer.data(), count);
+    else
+      analysis->Update(buffer.data(), count);
+
+    if (profiler != nullptr)
+      filter += Clock::now() - read;
+
+    total += count;
+  }
+
+  if (profiler != nullptr) {
+    profiler->Add(util::Profiler::kDecode, decode, reads);
+    profiler->Add(util::Profiler::kFilter, filter, reads);
+  }
+
+  return total;
+}
+
 }  // namespace
 
+// File shared by the analysis and the commit of an entry, so that it is
+// opened only once for both. Counts against kMaxOpenStreams while open.
+class Analyzer::Stream : public TagLib::FileStream {
+ public:
+  Stream(const fs::path& path, std::atomic<size_t>* count)
+      : FileStream{path.c_str()}, count_{count} {}
+
+  ~Stream() override {
+    count_->fetch_sub(1, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<size_t>* const count_;
+
+  Stream(const Stream&) = delete;
+  Stream& operator=(const Stream&) = delete;
+};
+
+struct Analyzer::Group {
+  // Results of the tracks analyzed by a single thread. Aligned so that the
+  // threads do not share a cache line.
+  struct alignas(64) Partial {
+    Partial()
+        : histogram{0.0, 0, LIB1770_SILENCE_GATE, {}},
+          peak{},
+          true_peak{-1.0},
+          tracks{} {}
+
+    void Merge(const audio::GainHistogram& other, double other_peak,
+               double other_true_peak) {
+      histogram.Merge(other);
+      peak = std::max(peak, other_peak);
+      true_peak = std::max(true_peak, other_true_peak);
+      ++tracks;
+    }
+
+    audio::GainHistogram histogram;
+    double peak;
+    double true_peak;  // negative if not measured.
+    size_t tracks;
+  };
+
+  Group(const std::string& key, size_t workers)
+      : key{key}, partials(workers + 1), pending{} {}
+
+  // Returns the partial results of the calling thread: one per worker of the
+  // pool, and the last one for the thread outside it.
+  Partial* GetPartial() {
+    auto index = util::ThreadPool::CurrentWorker();
+    if (index < 0 || partials.size() <= static_cast<size_t>(index) + 1)
+      return &partials.back();
+
+    return &partials[index];
+  }
+
+  std::string key;  // artist and album separated by a null character.
+
+  // Reduced once all the entries have been analyzed, so that the tracks of an
+  // album do not contend for a single aggregate.
+  std::vector<Partial> partials;
+  std::vector<Entry*> entries;
+
+  // Number of entries which have not been analyzed yet.
+  std::atomic<size_t> pending;
+};
+
 struct Analyzer::Entry {
-  explicit Entry(const fs::path& path) : path{path} {}
+  explicit Entry(const fs::path& path)
+      : path{path},
+        size{},
+        analyzed{},
+        loudness{},
+        peak{},
+        loudness_range{-1.0},
+        max_momentary{},
+        max_short_term{},
+        album_loudness{},
+        album_peak{} {}
 
   fs::path path;
-  std::shared_ptr<audio::GainAggregator> aggregator;
-  std::unique_ptr<audio::GainAnalysis> analysis;
+  uint64_t size;
+  std::shared_ptr<Group> group;
+
+  // Opened for the analysis and kept until the entry is committed.
+  std::unique_ptr<Stream> stream;
+
+  // iTunNORM value and other tags found in the file when it was added.
+  std::string normalization;
+  Tags tags;
+
+  // The full analysis is merged into the partial results of |group| and
+  // released as soon as the track has been analyzed; only its results are
+  // kept.
+  bool analyzed;
+  double loudness;
+  double peak;
+  double loudness_range;  // negative if not measured.
+  double max_momentary;
+  double max_short_term;
+  double album_loudness;
+  double album_peak;
+};
+
+// Shared by the segments of a track which is analyzed in parallel. Each
+// segment measures the blocks starting within it into its own analysis; the
+// last one to finish merges them.
+struct Analyzer::Segments {
+  Segments(double sampling_rate, const std::vector<uint32_t>& channel_map,
+           int measures, uint64_t length, size_t count)
+      : warm_up{static_cast<uint64_t>(sampling_rate * kWarmUpSeconds)},
+        pending{count},
+        failed{} {
+    for (size_t i = 0; i < count; ++i) {
+      analyses.emplace_back(std::make_unique<audio::GainAnalysis>(
+          sampling_rate, channel_map, measures));
+    }
+
+    // Segments start on block boundaries, so that they measure exactly the
+    // blocks a single analysis of the whole track would.
+    auto step = analyses.front()->step();
+    for (size_t i = 0; i < count; ++i)
+      starts.push_back(length * i / count / step * step);
+  }
+
+  std::vector<std::unique_ptr<audio::GainAnalysis>> analyses;
+  std::vector<uint64_t> starts;
+  const uint64_t warm_up;
+
+  // Number of segments which have not been analyzed yet.
+  std::atomic<size_t> pending;
+  std::atomic<bool> failed;
 };
 
 Analyzer::~Analyzer() = default;
 
-std::unique_ptr<Analyzer> Analyzer::CreateInstance() {
+std::unique_ptr<Analyzer> Analyzer::CreateInstance(const Options& options) {
   struct Bridge : Analyzer {};
-  return std::make_unique<Bridge>();
+  auto analyzer = std::make_unique<Bridge>();
+  if (!analyzer->Initialize(options))
+    return nullptr;
+
+  return analyzer;
 }
 
 void Analyzer::Add(const fs::path& path) {
   if (!fs::exists(path))
     return;
 
-  if (fs::is_directory(path)) {
-    for (auto& child : fs::recursive_directory_iterator(path))
-      AddFile(child);
-  } else {
-    AddFile(path);
-  }
-}
+  std::vector<std::unique_ptr<Entry>> candidates;
+  auto enqueue = [this, &candidates](const fs::path& file) {
+    auto extension = file.extension();
+    if (extension != *kMP3 && extension != *kM4A)
+      return;
 
-void Analyzer::Analyze() {
-#ifdef __cpp_lib_execution
-  std::for_each(std::execution::par_unseq, entries_.begin(), entries_.end(),
-                [this](auto& entry) { Analyze(&entry); });
-#else
-  std::mutex mutex;
-  auto current = entries_.begin();
-  auto end = entries_.end();
-
-  auto task = [this, &mutex, &current, &end]() {
-    while (true) {
-      mutex.lock();
-      if (current == end) {
-        mutex.unlock();
-        return;
-      }
-      auto& entry = *current;
-      ++current;
-      mutex.unlock();
-
-      Analyze(&entry);
-    }
+    if (added_.insert(file).second)
+      candidates.push_back(std::make_unique<Entry>(file));
   };
 
-  std::vector<std::thread> threads;
-  for (auto i = std::thread::hardware_concurrency(); i > 0; --i)
-    threads.emplace_back(task);
+  {
+    util::Profiler::Scope scope(profiler_.get(), util::Profiler::kScan, &path);
+    if (fs::is_directory(path)) {
+      for (auto& child : fs::recursive_directory_iterator(path))
+        enqueue(child.path());
+    } else {
+      enqueue(path);
+    }
+  }
 
-  for (auto& thread : threads)
-    thread.join();
-#endif
+  // Reading the tags dominates the scan of a large library, so the files are
+  // probed in parallel and then added in the order they were found.
+  std::vector<std::string> group_keys(candidates.size());
+  std::vector<char> valid(candidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    pool_->Post([this, &candidates, &group_keys, &valid, i]() {
+      util::Profiler::Scope scope(profiler_.get(), util::Profiler::kProbe,
+                                  &candidates[i]->path);
+      valid[i] = Probe(candidates[i].get(), &group_keys[i]);
+    });
+  }
+  pool_->Wait();
+
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (!valid[i])
+      continue;
+
+    auto entry = entries_.emplace_back(std::move(candidates[i])).get();
+    if (!group_keys[i].empty())
+      AddToGroup(group_keys[i], entry);
+  }
 }
 
-void Analyzer::Commit() {
-#ifdef __cpp_lib_execution
-  std::for_each(std::execution::par_unseq, entries_.begin(), entries_.end(),
-                [this](auto& entry) { Commit(&entry); });
-#else
-  for (auto& entry : entries_)
-    Commit(&entry);
-#endif
+void Analyzer::Run() {
+  // The pool has already probed the tags of the files in Add.
+  auto start = std::chrono::steady_clock::now();
+  auto busy_start = pool_->busy_time();
+
+  for (auto entry : GetSchedule()) {
+    pool_->Post([this, entry]() { Analyze(entry); });
+  }
+  pool_->Wait();
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::chrono::duration<double> busy = pool_->busy_time() - busy_start;
+  auto utilization = 0.0 < elapsed.count()
+                         ? busy / (elapsed * pool_->size()) * 100.0
+                         : 0.0;
+  std::clog << entries_.size() << " files in " << std::fixed
+            << std::setprecision(1) << elapsed.count() << " s, "
+            << pool_->size() << " jobs, " << utilization
+            << "% utilization" << std::endl;
+
+  // Throughput in seconds of audio decoded per second, overall and per job,
+  // to compare runs of the same files.
+  std::chrono::duration<double> decoded = std::chrono::nanoseconds(
+      decoded_.load(std::memory_order_relaxed));
+  if (0.0 < elapsed.count()) {
+    auto speed = decoded / elapsed;
+    std::clog << decoded.count() << " s decoded, " << speed << "x, "
+              << speed / pool_->size() << "x per job" << std::endl;
+  }
+
+  if (stats_)
+    profiler_->PrintSummary(&std::clog);
+  if (!trace_.empty())
+    profiler_->WriteTrace(trace_);
 }
 
-Analyzer::Analyzer() = default;
+Analyzer::Analyzer()
+    : incremental_{},
+      force_{},
+      fast_{},
+      pad_{},
+      measures_{},
+      replay_gain_{},
+      r128_{},
+      stats_{},
+      open_streams_{},
+      decoded_{} {}
 
-bool Analyzer::AddFile(const fs::path& path) {
-  if (added_.find(path) != added_.end())
-    return false;
+bool Analyzer::Initialize(const Options& options) {
+  incremental_ = options.incremental;
+  force_ = options.force;
+  fast_ = 1 < options.down_sample;
+  pad_ = options.pad;
+  if (options.true_peak)
+    measures_ |= audio::GainAnalysis::kTruePeak;
+  if (options.loudness_range)
+    measures_ |= audio::GainAnalysis::kLoudnessRange;
+  replay_gain_ = options.replay_gain;
+  r128_ = options.r128;
+  pool_ = std::make_unique<util::ThreadPool>(options.jobs);
+  stats_ = options.stats;
+  trace_ = options.trace;
+  if (stats_ || !trace_.empty()) {
+    profiler_ = std::make_unique<util::Profiler>(pool_->size(),
+                                                 !trace_.empty());
+  }
+  chksound::audio::SetDropCache(options.drop_cache);
+  chksound::audio::SetDownSample(options.down_sample);
+
+  if (!options.cache.empty() && !pad_) {
+    cache_ = AnalysisCache::Open(options.cache);
+    if (cache_ == nullptr)
+      return false;
+  }
 
-  auto extension = path.extension();
+  if (!options.report.empty()) {
+    auto format = options.csv || options.report.extension() == ".csv"
+                      ? Report::Format::kCsv
+                      : Report::Format::kJson;
+    report_ = Report::Open(options.report, format);
+    if (report_ == nullptr)
+      return false;
+  }
+
+  return true;
+}
+
+bool Analyzer::Probe(Entry* entry, std::string* group_key) {
+  std::error_code error;
+  entry->size = fs::file_size(entry->path, error);
+
+  auto extension = entry->path.extension();
   if (extension == *kMP3) {
-    TagLib::MPEG::File file(path.c_str(), false);
+    TagLib::MPEG::File file(entry->path.c_str(), false);
     if (file.isValid()) {
-      added_.emplace(path);
-      AddFile(&file, &entries_.emplace_back(path));
+      Probe(&file, entry, group_key);
       return true;
     }
   } else if (extension == *kM4A) {
-    TagLib::MP4::File file(path.c_str(), false);
+    TagLib::MP4::File file(entry->path.c_str(), false);
     if (file.isValid()) {
-      added_.emplace(path);
-      AddFile(&file, &entries_.emplace_back(path));
+      Probe(&file, entry, group_key);
       return true;
     }
   }
@@ -138,12 +476,27 @@ bool Analyzer::AddFile(const fs::path& path) {
   return false;
 }
 
-void Analyzer::AddFile(TagLib::MPEG::File* file, Entry* entry) {
+void Analyzer::Probe(TagLib::MPEG::File* file, Entry* entry,
+                     std::string* group_key) {
   if (!file->hasID3v2Tag())
     return;
 
   auto tag = file->ID3v2Tag();
 
+  auto comment = FindNormalization(tag);
+  if (comment != nullptr)
+    entry->normalization = comment->text().to8Bit(true);
+
+  auto read = [tag, entry](const char* key) {
+    auto frame = FindUserText(tag, key);
+    if (frame != nullptr && 1 < frame->fieldList().size())
+      entry->tags[key] = frame->fieldList()[1].to8Bit(true);
+  };
+  for (auto key : kReplayGainKeys)
+    read(key);
+  for (auto key : kR128Keys)
+    read(key);
+
   auto compilation = false;
   auto& tcmp = tag->frameList(*kTCMP);
   if (!tcmp.isEmpty()) {
@@ -156,71 +509,393 @@ void Analyzer::AddFile(TagLib::MPEG::File* file, Entry* entry) {
   if (!compilation) {
     auto artist = tag->artist();
     auto album = tag->album();
-    auto group_key = artist.to8Bit(true) + '\0' + album.to8Bit(true);
-    entry->aggregator = GetAggregator(group_key);
+    *group_key = artist.to8Bit(true) + '\0' + album.to8Bit(true);
   }
 }
 
-void Analyzer::AddFile(TagLib::MP4::File* file, Entry* entry) {
+void Analyzer::Probe(TagLib::MP4::File* file, Entry* entry,
+                     std::string* group_key) {
   if (!file->hasMP4Tag())
     return;
 
   auto tag = file->tag();
 
+  auto normalization = tag->item(*kNormalization);
+  if (normalization.isValid())
+    entry->normalization = normalization.toStringList().toString().to8Bit(true);
+
+  auto read = [tag, entry](const char* key) {
+    auto item = tag->item(std::string(kFreeformPrefix) + key);
+    if (item.isValid())
+      entry->tags[key] = item.toStringList().toString().to8Bit(true);
+  };
+  for (auto key : kReplayGainKeys)
+    read(key);
+  for (auto key : kR128Keys)
+    read(key);
+
   auto cpil = tag->item(*kCPIL);
   if (cpil.isValid() && !cpil.toBool()) {
     auto artist = tag->artist();
     auto album = tag->album();
-    auto group_key = artist.to8Bit(true) + '\0' + album.to8Bit(true);
-    entry->aggregator = GetAggregator(group_key);
+    *group_key = artist.to8Bit(true) + '\0' + album.to8Bit(true);
+  }
+}
+
+void Analyzer::AddToGroup(const std::string& key, Entry* entry) {
+  auto& group = groups_[key];
+  if (group == nullptr)
+    group = std::make_shared<Group>(key, pool_->size());
+
+  group->entries.push_back(entry);
+  ++group->pending;
+  entry->group = group;
+}
+
+void Analyzer::AddDecoded(const audio::AudioReader& reader, uint64_t frames) {
+  auto rate = reader.GetSamplingRate();
+  if (0.0 < rate) {
+    decoded_.fetch_add(static_cast<int64_t>(frames * 1e9 / rate),
+                       std::memory_order_relaxed);
+  }
+}
+
+std::unique_ptr<audio::AudioReader> Analyzer::Open(const Entry* entry,
+                                                  Stream* stream) {
+  util::Profiler::Scope scope(profiler_.get(), util::Profiler::kOpen,
+                              &entry->path);
+  return stream != nullptr ? chksound::audio::OpenAudio(stream)
+                           : chksound::audio::OpenAudio(entry->path);
+}
+
+void Analyzer::Finalize(audio::GainAnalysis* analysis) {
+  util::Profiler::Scope scope(profiler_.get(), util::Profiler::kFilter);
+  analysis->Finalize(pad_ ? audio::GainAnalysis::Tail::kPad
+                          : audio::GainAnalysis::Tail::kDrop);
+}
+
+std::vector<Analyzer::Entry*> Analyzer::GetSchedule() const {
+  std::vector<Entry*> schedule;
+  schedule.reserve(entries_.size());
+  for (auto& entry : entries_)
+    schedule.push_back(entry.get());
+
+  // Longest processing time first, estimated from the file size, so that a
+  // single long file does not end up running alone at the end.
+  std::stable_sort(schedule.begin(), schedule.end(),
+                   [](auto a, auto b) { return a->size > b->size; });
+
+  return schedule;
+}
+
+bool Analyzer::HasTags(const Entry* entry) const {
+  if (entry->normalization.empty())
+    return false;
+
+  if (replay_gain_) {
+    for (auto key : kReplayGainKeys) {
+      if (entry->tags.count(key) == 0)
+        return false;
+    }
   }
+
+  if (r128_) {
+    for (auto key : kR128Keys) {
+      if (entry->tags.count(key) == 0)
+        return false;
+    }
+  }
+
+  return true;
 }
 
-std::shared_ptr<audio::GainAggregator> Analyzer::GetAggregator(
-    const std::string& key) {
-  auto& aggregator = aggregators_[key];
-  if (aggregator == nullptr)
-    aggregator = std::make_shared<audio::GainAggregator>();
+bool Analyzer::IsTagged(const Entry* entry) const {
+  if (entry->group == nullptr)
+    return HasTags(entry);
+
+  // Album values depend on every track of the album.
+  for (auto member : entry->group->entries) {
+    if (!HasTags(member))
+      return false;
+  }
 
-  return aggregator;
+  return true;
 }
 
 void Analyzer::Analyze(Entry* entry) {
-  auto reader = chksound::audio::OpenAudio(entry->path);
+  if (incremental_ && !force_ && IsTagged(entry))
+    return Finish(entry, nullptr);
+
+  AnalysisCache::Record record;
+  if (cache_ != nullptr && cache_->Find(entry->path, &record) &&
+      (!(measures_ & audio::GainAnalysis::kTruePeak) ||
+       0.0 <= record.true_peak) &&
+      (!(measures_ & audio::GainAnalysis::kLoudnessRange) ||
+       0.0 <= record.loudness_range)) {
+    entry->loudness = record.loudness;
+    entry->peak = measures_ & audio::GainAnalysis::kTruePeak ? record.true_peak
+                                                             : record.peak;
+    entry->loudness_range = record.loudness_range;
+    entry->max_momentary = record.max_momentary;
+    entry->max_short_term = record.max_short_term;
+    entry->analyzed = true;
+
+    if (entry->group != nullptr) {
+      util::Profiler::Scope scope(profiler_.get(), util::Profiler::kMerge,
+                                  &entry->path);
+      entry->group->GetPartial()->Merge(record.histogram, record.peak,
+                                        record.true_peak);
+    }
+
+    return Finish(entry, nullptr);
+  }
+
+  // Albums are committed once all of their tracks have been analyzed, so the
+  // number of files kept open in the meantime is limited. Nothing is saved in
+  // the fast mode or when reporting. Where the reader cannot read through the
+  // stream, the file is opened for writing only when it is committed.
+  if (!fast_ && report_ == nullptr && audio::CanShareStream()) {
+    if (open_streams_.fetch_add(1, std::memory_order_relaxed) <
+        kMaxOpenStreams) {
+      entry->stream = std::make_unique<Stream>(entry->path, &open_streams_);
+      if (!entry->stream->isOpen())
+        entry->stream.reset();
+    } else {
+      open_streams_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  auto reader = Open(entry, entry->stream.get());
   if (reader == nullptr)
-    return;
+    return Finish(entry, nullptr);
 
+  auto channel_map = reader->GetChannelMap();
+  if (chksound::audio::GainAnalysis::kMaxChannels < channel_map.size())
+    return Finish(entry, nullptr);
+
+  auto sampling_rate = reader->GetSamplingRate();
+  auto length = reader->GetLength(
+      static_cast<uint64_t>(sampling_rate * kSegmentSeconds * 2));
+  auto count = std::min(
+      pool_->size(),
+      static_cast<size_t>(length / (sampling_rate * kSegmentSeconds)));
+  if (1 < count) {
+    auto segments =
+        std::make_shared<Segments>(sampling_rate, channel_map, measures_,
+                                   length, count);
+    for (size_t i = 1; i < count; ++i) {
+      pool_->Post([this, entry, segments, i]() {
+        Analyze(entry, segments, i, Open(entry, nullptr));
+      });
+    }
+
+    // The first segment starts where |reader| is.
+    return Analyze(entry, segments, 0, std::move(reader));
+  }
+
+  Analyze(entry, std::move(reader));
+}
+
+// Analyzes the whole track in a single pass.
+void Analyzer::Analyze(Entry* entry,
+                       std::unique_ptr<audio::AudioReader> reader) {
   auto analysis = std::make_unique<chksound::audio::GainAnalysis>(
-      reader->GetSamplingRate(), reader->GetChannels());
+      reader->GetSamplingRate(), reader->GetChannelMap(), measures_);
   if (analysis == nullptr)
+    return Finish(entry, nullptr);
+
+  auto start = util::Profiler::Clock::now();
+  AddDecoded(*reader, Feed(reader.get(), analysis.get(), UINT64_MAX, false,
+                           profiler_.get()));
+  Finalize(analysis.get());
+  auto failed = reader->HasFailed();
+  reader.reset();
+  if (profiler_ != nullptr) {
+    profiler_->Trace("analyze", start, util::Profiler::Clock::now(),
+                     entry->path);
+  }
+
+  // A track cut short by an error would be measured on its beginning only.
+  if (failed) {
+    std::cerr << "failed to decode: " << entry->path << std::endl;
+    return Finish(entry, nullptr);
+  }
+
+  Finish(entry, analysis.get());
+}
+
+void Analyzer::Analyze(Entry* entry, const std::shared_ptr<Segments>& segments,
+                       size_t index,
+                       std::unique_ptr<audio::AudioReader> reader) {
+  auto analysis = segments->analyses[index].get();
+  auto start = segments->starts[index];
+  auto warm_up = std::min(start, segments->warm_up);
+
+  auto time = util::Profiler::Clock::now();
+  if (reader != nullptr && (index == 0 || reader->Seek(start - warm_up))) {
+    AddDecoded(*reader, Feed(reader.get(), analysis, warm_up, true,
+                             profiler_.get()));
+
+    // The blocks starting before the next segment extend into it.
+    auto frames = UINT64_MAX;
+    if (index + 1 < segments->starts.size()) {
+      auto end = segments->starts[index + 1] - start;
+      analysis->SetEnd(end);
+      frames = end + analysis->overlap();
+    }
+    AddDecoded(*reader, Feed(reader.get(), analysis, frames, false,
+                             profiler_.get()));
+
+    if (frames == UINT64_MAX)
+      Finalize(analysis);
+
+    if (reader->HasFailed())
+      segments->failed.store(true, std::memory_order_relaxed);
+  } else {
+    segments->failed.store(true, std::memory_order_relaxed);
+  }
+  reader.reset();
+  if (profiler_ != nullptr) {
+    profiler_->Trace("analyze", time, util::Profiler::Clock::now(),
+                     entry->path);
+  }
+
+  if (segments->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
     return;
 
-  for (double samples[8]; reader->Read(samples);)
-    analysis->Update(samples);
+  // A segment which could not be opened, positioned or decoded is no reason to
+  // give up the track, which is analyzed again in a single pass instead.
+  if (segments->failed.load(std::memory_order_relaxed)) {
+    auto reader = Open(entry, entry->stream.get());
+    if (reader == nullptr)
+      return Finish(entry, nullptr);
+
+    return Analyze(entry, std::move(reader));
+  }
+
+  auto& result = segments->analyses.front();
+  {
+    util::Profiler::Scope scope(profiler_.get(), util::Profiler::kMerge,
+                                &entry->path);
+    for (size_t i = 1; i < segments->analyses.size(); ++i)
+      result->Merge(*segments->analyses[i]);
+  }
+
+  Finish(entry, result.get());
+}
+
+void Analyzer::Finish(Entry* entry, audio::GainAnalysis* analysis) {
+  if (analysis != nullptr) {
+    entry->loudness = analysis->Loudness();
+    entry->peak = measures_ & audio::GainAnalysis::kTruePeak
+                      ? analysis->TruePeak()
+                      : analysis->Peak();
+    entry->loudness_range = analysis->LoudnessRange();
+    entry->max_momentary = analysis->MaxMomentary();
+    if (0.0 <= entry->loudness_range)
+      entry->max_short_term = analysis->MaxShortTerm();
+    entry->analyzed = true;
+
+    // Approximate results must not be mistaken for precise ones later.
+    if (cache_ != nullptr && !fast_) {
+      AnalysisCache::Record record;
+      record.loudness = entry->loudness;
+      record.peak = analysis->Peak();
+      record.true_peak = analysis->TruePeak();
+      record.loudness_range = entry->loudness_range;
+      record.max_momentary = entry->max_momentary;
+      record.max_short_term = entry->max_short_term;
+      analysis->GetHistogram(&record.histogram);
+      cache_->Store(entry->path, record);
+    }
+
+    if (entry->group != nullptr) {
+      util::Profiler::Scope scope(profiler_.get(), util::Profiler::kMerge,
+                                  &entry->path);
+      audio::GainHistogram histogram;
+      analysis->GetHistogram(&histogram);
+      entry->group->GetPartial()->Merge(histogram, analysis->Peak(),
+                                        analysis->TruePeak());
+    }
+  }
 
-  entry->analysis = std::move(analysis);
+  // The report holds these values too.
+  if (entry->analyzed && 0.0 <= entry->loudness_range && report_ == nullptr) {
+    std::scoped_lock<std::mutex> lock(output_mutex_);
+    std::cout << entry->path.u8string() << ": " << std::fixed
+              << std::setprecision(1) << "LRA " << entry->loudness_range
+              << " LU, max momentary " << entry->max_momentary
+              << " LUFS, max short-term " << entry->max_short_term << " LUFS"
+              << std::endl;
+  }
 
-  if (entry->aggregator != nullptr)
-    entry->aggregator->Merge(entry->analysis.get());
+  auto group = entry->group.get();
+  if (group == nullptr) {
+    Commit(entry);
+  } else if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    Complete(group);
+    for (auto member : group->entries)
+      Commit(member);
+  }
 }
 
-void Analyzer::Commit(const Entry* entry) {
-  if (entry->analysis == nullptr)
+void Analyzer::Complete(Group* group) {
+  if (group->partials.empty())
     return;
 
-  auto track_gain = -18.0 - entry->analysis->Loudness();
-  auto track_peak = static_cast<int>(entry->analysis->Peak() * 32768);
+  util::Profiler::Scope scope(profiler_.get(), util::Profiler::kMerge);
+  audio::GainAggregator aggregator;
+  for (auto& partial : group->partials) {
+    if (0 < partial.tracks)
+      aggregator.Merge(partial.histogram, partial.peak, partial.true_peak);
+  }
 
-  double album_gain;
-  int album_peak;
-  if (entry->aggregator != nullptr) {
-    album_gain = -18.0 - entry->aggregator->Loudness();
-    album_peak = static_cast<int>(entry->aggregator->Peak() * 32768);
-  } else {
-    album_gain = track_gain;
-    album_peak = track_peak;
+  auto loudness = aggregator.Loudness();
+  auto peak = measures_ & audio::GainAnalysis::kTruePeak
+                  ? aggregator.TruePeak()
+                  : aggregator.Peak();
+  for (auto entry : group->entries) {
+    entry->album_loudness = loudness;
+    entry->album_peak = peak;
+  }
+
+  if (report_ != nullptr) {
+    Report::Record record{};
+    record.group = GetReportGroup(group->key);
+    record.loudness = loudness;
+    record.peak = peak;
+    record.loudness_range = -1.0;
+    report_->Write(record);
   }
 
+  // The album values have been copied out; the histograms are no longer
+  // needed.
+  group->partials.clear();
+}
+
+void Analyzer::Commit(Entry* entry) {
+  util::Profiler::Scope scope(profiler_.get(), util::Profiler::kCommit,
+                              &entry->path);
+
+  // Whether or not the tags are saved, the file is closed at the end.
+  auto stream = std::move(entry->stream);
+
+  if (!entry->analyzed)
+    return;
+
+  auto album_loudness = entry->loudness;
+  auto album_peak = entry->peak;
+  if (entry->group != nullptr) {
+    album_loudness = entry->album_loudness;
+    album_peak = entry->album_peak;
+  }
+
+  auto track_gain = -18.0 - entry->loudness;
+  auto album_gain = -18.0 - album_loudness;
+
+  if (fast_ && report_ == nullptr)
+    return Screen(entry, track_gain, album_gain);
+
   int values[] = {
       GetAdjustment(track_gain, 1000),
       GetAdjustment(album_gain, 1000),
@@ -228,8 +903,8 @@ void Analyzer::Commit(const Entry* entry) {
       GetAdjustment(album_gain, 2500),
       0,
       0,
-      track_peak,
-      album_peak,
+      static_cast<int>(entry->peak * 32768),
+      static_cast<int>(album_peak * 32768),
       0,
       0,
   };
@@ -239,30 +914,88 @@ void Analyzer::Commit(const Entry* entry) {
     buffer << " " << std::uppercase << std::setfill('0') << std::setw(8)
            << std::hex << value;
 
+  // ReplayGain 2.0 shares the reference level of iTunNORM.
+  Tags tags;
+  if (replay_gain_) {
+    tags[kTrackGain] = FormatDecimal(track_gain, 2) + " dB";
+    tags[kTrackPeak] = FormatDecimal(entry->peak, 6);
+    tags[kAlbumGain] = FormatDecimal(album_gain, 2) + " dB";
+    tags[kAlbumPeak] = FormatDecimal(album_peak, 6);
+  }
+
+  if (r128_) {
+    tags[kR128TrackGain] = FormatR128Gain(entry->loudness);
+    tags[kR128AlbumGain] = FormatR128Gain(album_loudness);
+  }
+
+  auto changed = force_ || buffer.str() != entry->normalization ||
+                 !std::includes(entry->tags.begin(), entry->tags.end(),
+                                tags.begin(), tags.end());
+
+  // Nothing is opened or saved for the report.
+  if (report_ != nullptr) {
+    Report::Record record{};
+    record.path = entry->path.u8string();
+    if (entry->group != nullptr)
+      record.group = GetReportGroup(entry->group->key);
+    record.loudness = entry->loudness;
+    record.peak = entry->peak;
+    record.loudness_range = entry->loudness_range;
+    record.max_momentary = entry->max_momentary;
+    record.max_short_term = entry->max_short_term;
+    record.normalization = buffer.str();
+    record.changed = changed;
+    report_->Write(record);
+    return;
+  }
+
+  if (!changed)
+    return;
+
+  auto saved = false;
   auto extension = entry->path.extension();
+  if (stream == nullptr) {
+    open_streams_.fetch_add(1, std::memory_order_relaxed);
+    stream = std::make_unique<Stream>(entry->path, &open_streams_);
+  }
+
   if (extension == *kMP3) {
-    TagLib::MPEG::File file(entry->path.c_str(), false);
+    TagLib::MPEG::File file(stream.get(),
+                            TagLib::ID3v2::FrameFactory::instance(), false);
     if (file.isValid())
-      Commit(buffer.str(), &file);
+      saved = Commit(buffer.str(), tags, &file);
   } else if (extension == *kM4A) {
-    TagLib::MP4::File file(entry->path.c_str(), false);
+    TagLib::MP4::File file(stream.get(), false);
     if (file.isValid())
-      Commit(buffer.str(), &file);
+      saved = Commit(buffer.str(), tags, &file);
   }
+
+  // Rewriting the tags does not change the audio, so the cached analysis
+  // stays valid.
+  if (saved && cache_ != nullptr)
+    cache_->Refresh(entry->path);
 }
 
-void Analyzer::Commit(const std::string& normalization,
+void Analyzer::Screen(const Entry* entry, double track_gain,
+                      double album_gain) {
+  // iTunNORM starts with the track and the album adjustments.
+  auto text = entry->normalization.c_str();
+  char* end;
+  auto track = static_cast<int>(strtol(text, &end, 16));
+  auto album = static_cast<int>(strtol(end, &end, 16));
+  if (0 < track && 0 < album &&
+      fabs(GetGain(track, 1000) - track_gain) <= kScreenTolerance &&
+      fabs(GetGain(album, 1000) - album_gain) <= kScreenTolerance)
+    return;
+
+  std::scoped_lock<std::mutex> lock(output_mutex_);
+  std::cout << entry->path.u8string() << std::endl;
+}
+
+bool Analyzer::Commit(const std::string& normalization, const Tags& tags,
                       TagLib::MPEG::File* file) {
   auto tag = file->ID3v2Tag(true);
-  TagLib::ID3v2::CommentsFrame* comment = nullptr;
-  for (auto f : tag->frameList("COMM")) {
-    auto frame = static_cast<TagLib::ID3v2::CommentsFrame*>(f);
-    if (wcscasecmp(frame->description().toCWString(), L"iTunNORM") == 0) {
-      comment = frame;
-      break;
-    }
-  }
-
+  auto comment = FindNormalization(tag);
   if (comment == nullptr) {
     comment = new TagLib::ID3v2::CommentsFrame();
     comment->setLanguage("eng");
@@ -273,11 +1006,26 @@ void Analyzer::Commit(const std::string& normalization,
     comment->setText(normalization);
   }
 
-  if (!file->save(TagLib::MPEG::File::ID3v2))
+  for (auto& pair : tags) {
+    auto frame = FindUserText(tag, pair.first);
+    if (frame == nullptr) {
+      frame = new TagLib::ID3v2::UserTextIdentificationFrame(
+          TagLib::String::UTF8);
+      frame->setDescription(pair.first);
+      tag->addFrame(frame);
+    }
+    frame->setText(pair.second);
+  }
+
+  if (!file->save(TagLib::MPEG::File::ID3v2)) {
     std::cerr << "failed to save" << std::endl;
+    return false;
+  }
+
+  return true;
 }
 
-void Analyzer::Commit(const std::string& normalization,
+bool Analyzer::Commit(const std::string& normalization, const Tags& tags,
                       TagLib::MP4::File* file) {
   TagLib::StringList list;
   list.append(normalization);
@@ -285,10 +1033,19 @@ void Analyzer::Commit(const std::string& normalization,
   TagLib::MP4::Item item(list);
 
   auto tag = file->tag();
-  tag->setItem("----:com.apple.iTunes:iTunNORM", item);
+  tag->setItem(*kNormalization, item);
+
+  for (auto& pair : tags) {
+    tag->setItem(std::string(kFreeformPrefix) + pair.first,
+                 TagLib::StringList(pair.second));
+  }
 
-  if (!file->save())
+  if (!file->save()) {
     std::cerr << "failed to save" << std::endl;
+    return false;
+  }
+
+  return true;
 }
 
 }  // namespace chksound::app
@@ -3,11 +3,13 @@
 #ifndef CHKSOUND_APP_ANALYZER_H_
 #define CHKSOUND_APP_ANALYZER_H_
 
+#include <atomic>
 #include <filesystem>
 #include <map>
 #include <memory>
-#include <set>
+#include <mutex>  // NOLINT(build/c++11)
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace TagLib {
@@ -27,42 +29,157 @@ class File;
 namespace chksound {
 namespace audio {
 
-class GainAggregator;
+class AudioReader;
+class GainAnalysis;
 
 }  // namespace audio
 
+namespace util {
+
+class Profiler;
+class ThreadPool;
+
+}  // namespace util
+
 namespace app {
 
+class AnalysisCache;
+class Report;
+
 class Analyzer {
  public:
+  struct Options {
+    // Path to the analysis cache; empty to analyze every file.
+    std::filesystem::path cache;
+
+    // Skips tracks whose album is already tagged entirely.
+    bool incremental;
+
+    // Analyzes and saves every track, even if its tag would not change.
+    bool force;
+
+    // Number of worker threads; 0 to use one per hardware thread.
+    size_t jobs;
+
+    // Drops the data of each file from the page cache once it is decoded.
+    bool drop_cache;
+
+    // Decodes at 1/down_sample of the sampling rate, 2 or 4; 0 for the full
+    // rate. The results are then approximate: nothing is cached or saved, and
+    // the files whose tag seems out of date are listed instead.
+    int down_sample;
+
+    // Completes the last blocks of each track with silence instead of dropping
+    // them, so that tracks shorter than a block are measured too. The cache
+    // is not used then, since it holds the results of the standard policy.
+    bool pad;
+
+    // Writes the true peak of ITU BS.1770-4 instead of the sample peak, which
+    // misses the overs between the samples of lossy streams.
+    bool true_peak;
+
+    // Lists the loudness range and the maximum momentary and short-term
+    // loudness of each track.
+    bool loudness_range;
+
+    // Writes the REPLAYGAIN_* tags of ReplayGain 2.0 and the R128_* tags
+    // besides iTunNORM. Every tag of a file is saved at once.
+    bool replay_gain;
+    bool r128;
+
+    // Prints the time spent in each stage of the run at the end.
+    bool stats;
+
+    // Path to write the stages of each file to as a trace of Chrome; empty not
+    // to write one.
+    std::filesystem::path trace;
+
+    // Path to write the results of each track and album to instead of saving
+    // any tag, "-" for the standard output; empty to save the tags. Written as
+    // JSON lines unless |csv| is true or the path ends with .csv.
+    std::filesystem::path report;
+    bool csv;
+  };
+
   ~Analyzer();
 
-  static std::unique_ptr<Analyzer> CreateInstance();
+  static std::unique_ptr<Analyzer> CreateInstance(const Options& options);
 
   void Add(const std::filesystem::path& path);
-  void Analyze();
-  void Commit();
+
+  // Analyzes the added files and commits each album as soon as all of its
+  // tracks have been analyzed, instead of analyzing everything first.
+  void Run();
 
  private:
   struct Entry;
+  struct Group;
+  struct Segments;
+  class Stream;
 
-  Analyzer();
+  // Values of the tags other than iTunNORM, by name.
+  using Tags = std::map<std::string, std::string>;
 
-  bool AddFile(const std::filesystem::path& path);
-  void AddFile(TagLib::MPEG::File* file, Entry* entry);
-  void AddFile(TagLib::MP4::File* file, Entry* entry);
+  struct PathHash {
+    size_t operator()(const std::filesystem::path& path) const {
+      return std::filesystem::hash_value(path);
+    }
+  };
 
-  void Analyze(Entry* entry);
+  Analyzer();
 
-  void Commit(const Entry* entry);
-  void Commit(const std::string& normalization, TagLib::MPEG::File* file);
-  void Commit(const std::string& normalization, TagLib::MP4::File* file);
+  bool Initialize(const Options& options);
 
-  std::shared_ptr<audio::GainAggregator> GetAggregator(const std::string& key);
+  // Reads the tag of |entry| and sets |group_key| if the track belongs to an
+  // album. Returns false if the file is not supported. Called concurrently.
+  bool Probe(Entry* entry, std::string* group_key);
+  void Probe(TagLib::MPEG::File* file, Entry* entry, std::string* group_key);
+  void Probe(TagLib::MP4::File* file, Entry* entry, std::string* group_key);
 
-  std::set<std::filesystem::path> added_;
-  std::map<std::string, std::shared_ptr<audio::GainAggregator>> aggregators_;
-  std::vector<Entry> entries_;
+  std::vector<Entry*> GetSchedule() const;
+  bool HasTags(const Entry* entry) const;
+  bool IsTagged(const Entry* entry) const;
+  std::unique_ptr<audio::AudioReader> Open(const Entry* entry,
+                                           Stream* stream);
+  void Finalize(audio::GainAnalysis* analysis);
+  void Analyze(Entry* entry);
+  void Analyze(Entry* entry, std::unique_ptr<audio::AudioReader> reader);
+  void Analyze(Entry* entry, const std::shared_ptr<Segments>& segments,
+               size_t index, std::unique_ptr<audio::AudioReader> reader);
+  void Finish(Entry* entry, audio::GainAnalysis* analysis);
+  void Complete(Group* group);
+
+  void Commit(Entry* entry);
+  void Screen(const Entry* entry, double track_gain, double album_gain);
+  bool Commit(const std::string& normalization, const Tags& tags,
+              TagLib::MPEG::File* file);
+  bool Commit(const std::string& normalization, const Tags& tags,
+              TagLib::MP4::File* file);
+
+  void AddToGroup(const std::string& key, Entry* entry);
+  void AddDecoded(const audio::AudioReader& reader, uint64_t frames);
+
+  std::unique_ptr<AnalysisCache> cache_;
+  std::unique_ptr<Report> report_;  // null to save the tags.
+  bool incremental_;
+  bool force_;
+  bool fast_;
+  bool pad_;
+  int measures_;  // combination of audio::GainAnalysis::Measure.
+  bool replay_gain_;
+  bool r128_;
+  std::unique_ptr<util::ThreadPool> pool_;
+  std::unique_ptr<util::Profiler> profiler_;  // null unless requested.
+  bool stats_;
+  std::filesystem::path trace_;
+  std::atomic<size_t> open_streams_;
+  std::atomic<int64_t> decoded_;  // nanoseconds of audio decoded.
+
+  std::unordered_set<std::filesystem::path, PathHash> added_;
+  std::map<std::string, std::shared_ptr<Group>> groups_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+
+  std::mutex output_mutex_;
 
   Analyzer(const Analyzer&) = delete;
   Analyzer& operator=(const Analyzer&) = delete;
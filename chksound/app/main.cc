@@ -1,19 +1,97 @@
 // Copyright (c) 2019 dacci.org
 
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
 #include "app/analyzer.h"
 
+namespace fs = ::std::filesystem;
+
+namespace {
+
+bool ParseSize(const fs::path& text, size_t* value) {
+  auto string = text.u8string();
+  char* end;
+  auto number = strtoull(string.c_str(), &end, 10);
+  if (string.empty() || *end != '\0')
+    return false;
+
+  *value = static_cast<size_t>(number);
+  return true;
+}
+
+}  // namespace
+
 #ifdef _UNICODE
 int wmain(int argc, const wchar_t* const* argv) {
 #else
 int main(int argc, const char* const* argv) {
 #endif
-  auto analyzer = chksound::app::Analyzer::CreateInstance();
+  chksound::app::Analyzer::Options options{};
+  std::vector<fs::path> paths;
+  size_t factor;
+
+  for (auto i = 1; i < argc; ++i) {
+    fs::path arg(argv[i]);
+    auto name = arg.u8string();
+    if (name.compare(0, 2, "--") != 0) {
+      paths.push_back(arg);
+      continue;
+    }
+
+    auto value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (name == "--incremental") {
+      options.incremental = true;
+    } else if (name == "--force") {
+      options.force = true;
+    } else if (name == "--drop-cache") {
+      options.drop_cache = true;
+    } else if (name == "--pad") {
+      options.pad = true;
+    } else if (name == "--true-peak") {
+      options.true_peak = true;
+    } else if (name == "--loudness-range") {
+      options.loudness_range = true;
+    } else if (name == "--replaygain") {
+      options.replay_gain = true;
+    } else if (name == "--r128") {
+      options.r128 = true;
+    } else if (name == "--stats") {
+      options.stats = true;
+    } else if (name == "--csv") {
+      options.csv = true;
+    } else if (name == "--cache" && value != nullptr) {
+      options.cache = value;
+      ++i;
+    } else if (name == "--trace" && value != nullptr) {
+      options.trace = value;
+      ++i;
+    } else if (name == "--report" && value != nullptr) {
+      options.report = value;
+      ++i;
+    } else if (name == "--jobs" && value != nullptr &&
+               ParseSize(value, &options.jobs)) {
+      ++i;
+    } else if (name == "--fast" && value != nullptr &&
+               ParseSize(value, &factor) && (factor == 2 || factor == 4)) {
+      options.down_sample = static_cast<int>(factor);
+      ++i;
+    } else {
+      std::cerr << "invalid option: " << name << std::endl;
+      return 1;
+    }
+  }
+
+  auto analyzer = chksound::app::Analyzer::CreateInstance(options);
+  if (analyzer == nullptr)
+    return 1;
 
-  for (auto i = 1; i < argc; ++i)
-    analyzer->Add(argv[i]);
+  for (auto& path : paths)
+    analyzer->Add(path);
 
-  analyzer->Analyze();
-  analyzer->Commit();
+  analyzer->Run();
 
   return 0;
 }
@@ -0,0 +1,158 @@
+// Copyright (c) 2026 dacci.org
+
+#include "app/report.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "util/json.h"
+
+namespace fs = ::std::filesystem;
+
+namespace chksound::app {
+namespace {
+
+constexpr char kCsvHeader[] =
+    "type,path,group,loudness,peak,loudness_range,max_momentary,"
+    "max_short_term,normalization,changed";
+
+// Writes |value| with |precision| digits after the point, or |absent| if it
+// is not a finite number.
+void WriteNumber(std::ostream* stream, double value, int precision,
+                 const char* absent) {
+  if (std::isfinite(value))
+    *stream << std::fixed << std::setprecision(precision) << value;
+  else
+    *stream << absent;
+}
+
+// Quotes |text| if it contains a character special to CSV.
+void WriteCsvField(std::ostream* stream, const std::string& text) {
+  if (text.find_first_of(",\"\r\n") == std::string::npos) {
+    *stream << text;
+    return;
+  }
+
+  *stream << '"';
+  for (auto c : text) {
+    if (c == '"')
+      *stream << '"';
+    *stream << c;
+  }
+  *stream << '"';
+}
+
+}  // namespace
+
+Report::~Report() = default;
+
+std::unique_ptr<Report> Report::Open(const fs::path& path, Format format) {
+  struct Bridge : Report {};
+  auto report = std::make_unique<Bridge>();
+  report->format_ = format;
+
+  if (path == "-") {
+    report->stream_ = &std::cout;
+  } else {
+    report->file_.open(path, std::ios::trunc);
+    if (!report->file_) {
+      std::cerr << "failed to open report: " << path << std::endl;
+      return nullptr;
+    }
+
+    report->stream_ = &report->file_;
+  }
+
+  if (format == Format::kCsv)
+    *report->stream_ << kCsvHeader << std::endl;
+
+  return report;
+}
+
+void Report::Write(const Record& record) {
+  // Formatted out of the lock, so that only the output is serialized.
+  std::ostringstream line;
+  if (format_ == Format::kCsv)
+    WriteCsv(&line, record);
+  else
+    WriteJson(&line, record);
+
+  std::scoped_lock<std::mutex> lock(mutex_);
+  *stream_ << line.str() << std::endl;
+}
+
+Report::Report() : format_{Format::kJson}, stream_{} {}
+
+void Report::WriteJson(std::ostream* stream, const Record& record) const {
+  auto track = !record.path.empty();
+  auto measured = 0.0 <= record.loudness_range;
+
+  *stream << "{\"type\":\"" << (track ? "track" : "album") << "\"";
+  if (track) {
+    *stream << ",\"path\":";
+    util::WriteJsonString(stream, record.path);
+  }
+
+  *stream << ",\"group\":";
+  if (record.group.empty())
+    *stream << "null";
+  else
+    util::WriteJsonString(stream, record.group);
+
+  *stream << ",\"loudness\":";
+  WriteNumber(stream, record.loudness, 2, "null");
+  *stream << ",\"peak\":";
+  WriteNumber(stream, record.peak, 6, "null");
+
+  if (measured) {
+    *stream << ",\"loudness_range\":";
+    WriteNumber(stream, record.loudness_range, 2, "null");
+    *stream << ",\"max_momentary\":";
+    WriteNumber(stream, record.max_momentary, 2, "null");
+    *stream << ",\"max_short_term\":";
+    WriteNumber(stream, record.max_short_term, 2, "null");
+  }
+
+  if (track) {
+    *stream << ",\"normalization\":";
+    util::WriteJsonString(stream, record.normalization);
+    *stream << ",\"changed\":" << (record.changed ? "true" : "false");
+  }
+
+  *stream << "}";
+}
+
+void Report::WriteCsv(std::ostream* stream, const Record& record) const {
+  auto track = !record.path.empty();
+  auto measured = 0.0 <= record.loudness_range;
+
+  *stream << (track ? "track" : "album") << ",";
+  WriteCsvField(stream, record.path);
+  *stream << ",";
+  WriteCsvField(stream, record.group);
+  *stream << ",";
+  WriteNumber(stream, record.loudness, 2, "");
+  *stream << ",";
+  WriteNumber(stream, record.peak, 6, "");
+  *stream << ",";
+  if (measured) {
+    WriteNumber(stream, record.loudness_range, 2, "");
+    *stream << ",";
+    WriteNumber(stream, record.max_momentary, 2, "");
+    *stream << ",";
+    WriteNumber(stream, record.max_short_term, 2, "");
+  } else {
+    *stream << ",,";
+  }
+  *stream << ",";
+  if (track) {
+    WriteCsvField(stream, record.normalization);
+    *stream << "," << (record.changed ? 1 : 0);
+  } else {
+    *stream << ",";
+  }
+}
+
+}  // namespace chksound::app
@@ -0,0 +1,64 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_APP_REPORT_H_
+#define CHKSOUND_APP_REPORT_H_
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <ostream>
+#include <string>
+
+namespace chksound::app {
+
+// Writes the results of each track and album, one per line, as JSON objects
+// or as CSV after a header line. Written to concurrently.
+class Report {
+ public:
+  enum class Format {
+    kJson,
+    kCsv,
+  };
+
+  struct Record {
+    std::string path;   // empty for an album.
+    std::string group;  // artist and album separated by a tab, if any.
+    double loudness;
+    double peak;
+    double loudness_range;  // negative if not measured.
+    double max_momentary;
+    double max_short_term;
+
+    // iTunNORM of a track, and whether it or any other tag of the track would
+    // be rewritten.
+    std::string normalization;
+    bool changed;
+  };
+
+  ~Report();
+
+  // Writes to the standard output if |path| is "-".
+  static std::unique_ptr<Report> Open(const std::filesystem::path& path,
+                                      Format format);
+
+  void Write(const Record& record);
+
+ private:
+  Report();
+
+  void WriteJson(std::ostream* stream, const Record& record) const;
+  void WriteCsv(std::ostream* stream, const Record& record) const;
+
+  Format format_;
+  std::ofstream file_;
+  std::ostream* stream_;
+  std::mutex mutex_;
+
+  Report(const Report&) = delete;
+  Report& operator=(const Report&) = delete;
+};
+
+}  // namespace chksound::app
+
+#endif  // CHKSOUND_APP_REPORT_H_
@@ -0,0 +1,47 @@
+// Copyright (c) 2026 dacci.org
+
+#include "audio/audio_reader.h"
+
+#include <iterator>
+
+namespace chksound::audio {
+namespace {
+
+// Usual layouts by the number of channels, as WAVEFORMATEXTENSIBLE masks.
+const uint32_t kDefaultMasks[] = {
+    0,
+    kFrontCenter,
+    kFrontLeft | kFrontRight,
+    kFrontLeft | kFrontRight | kFrontCenter,
+    kFrontLeft | kFrontRight | kBackLeft | kBackRight,
+    kFrontLeft | kFrontRight | kFrontCenter | kBackLeft | kBackRight,
+    kFrontLeft | kFrontRight | kFrontCenter | kLowFrequency | kBackLeft |
+        kBackRight,
+    kFrontLeft | kFrontRight | kFrontCenter | kLowFrequency | kBackCenter |
+        kSideLeft | kSideRight,
+    kFrontLeft | kFrontRight | kFrontCenter | kLowFrequency | kBackLeft |
+        kBackRight | kSideLeft | kSideRight,
+};
+
+}  // namespace
+
+std::vector<uint32_t> AudioReader::GetChannelMap() const {
+  auto channels = GetChannels();
+  if (channels < 0 || std::size(kDefaultMasks) <= static_cast<size_t>(channels))
+    return GetChannelMap(0, channels);
+
+  return GetChannelMap(kDefaultMasks[channels], channels);
+}
+
+std::vector<uint32_t> AudioReader::GetChannelMap(uint32_t mask, int channels) {
+  std::vector<uint32_t> map;
+  for (auto i = 0; i < channels; ++i) {
+    auto speaker = mask & (~mask + 1);
+    map.push_back(speaker);
+    mask &= ~speaker;
+  }
+
+  return map;
+}
+
+}  // namespace chksound::audio
@@ -3,23 +3,101 @@
 #ifndef CHKSOUND_AUDIO_AUDIO_READER_H_
 #define CHKSOUND_AUDIO_AUDIO_READER_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <memory>
+#include <vector>
+
+namespace TagLib {
+
+class IOStream;
+
+}  // namespace TagLib
 
 namespace chksound::audio {
 
+// Speaker positions, as the bits of WAVEFORMATEXTENSIBLE::dwChannelMask and of
+// AudioChannelBitmap.
+enum Speaker : uint32_t {
+  kFrontLeft = 0x1,
+  kFrontRight = 0x2,
+  kFrontCenter = 0x4,
+  kLowFrequency = 0x8,
+  kBackLeft = 0x10,
+  kBackRight = 0x20,
+  kFrontLeftOfCenter = 0x40,
+  kFrontRightOfCenter = 0x80,
+  kBackCenter = 0x100,
+  kSideLeft = 0x200,
+  kSideRight = 0x400,
+};
+
 class AudioReader {
  public:
   virtual ~AudioReader() {}
 
-  virtual bool Read(double* buffer) = 0;
+  // Reads up to |frames| interleaved frames into |buffer|, which must be large
+  // enough to hold |frames| * GetChannels() samples. Returns the number of
+  // frames actually read, or 0 at the end of the stream or on error.
+  virtual size_t Read(double* buffer, size_t frames) = 0;
+
+  // Returns the length of the stream in frames, or 0 if it is unknown. A
+  // length shorter than |exact_from| frames may be an estimate, so that
+  // readers need not go through the whole stream to find that out.
+  virtual uint64_t GetLength(uint64_t exact_from) {
+    return 0;
+  }
+
+  // Positions the stream so that the next Read starts at |frame|. Returns
+  // false if the reader cannot seek sample-accurately.
+  virtual bool Seek(uint64_t frame) {
+    return false;
+  }
+
+  // Returns true if Read stopped short on an error rather than at the end of
+  // the stream.
+  virtual bool HasFailed() const {
+    return false;
+  }
 
   virtual double GetSamplingRate() const = 0;
   virtual int GetChannels() const = 0;
+
+  // Returns the Speaker position of each channel, or 0 for a channel whose
+  // position is unknown. By default, the channels are assumed to follow the
+  // usual layout for their number, e.g. L, R, C, LFE, Ls, Rs for six.
+  virtual std::vector<uint32_t> GetChannelMap() const;
+
+ protected:
+  // Assigns the speakers in |mask| to |channels| channels, in the order of
+  // their bits.
+  static std::vector<uint32_t> GetChannelMap(uint32_t mask, int channels);
 };
 
 std::unique_ptr<AudioReader> OpenAudio(const std::filesystem::path& path);
 
+// Returns true if OpenAudio(TagLib::IOStream*) reads the audio through the
+// stream. Where it does not, it opens the file again by its name, and a stream
+// kept open for it would only hold the file open.
+bool CanShareStream();
+
+// Opens the audio of the file |stream| is open on, so that the file is not
+// read again to read or write its tags. |stream| must outlive the reader.
+std::unique_ptr<AudioReader> OpenAudio(TagLib::IOStream* stream);
+
+// Advises the system to drop the data of a file from the page cache once a
+// reader has consumed it, where supported. Off by default.
+void SetDropCache(bool enable);
+
+// Makes readers map the files they read into memory, where supported, rather
+// than read them in buffered chunks. On by default.
+void SetMemoryMap(bool enable);
+
+// Makes readers decode at 1/|factor| of the sampling rate, where supported,
+// trading accuracy for speed. |factor| is 1, 2 or 4; 1 by default.
+void SetDownSample(int factor);
+
 }  // namespace chksound::audio
 
 #endif  // CHKSOUND_AUDIO_AUDIO_READER_H_
@@ -2,59 +2,170 @@
 
 #include "audio/audio_reader.h"
 
+#include <fcntl.h>
 #include <mpg123.h>
+#include <neaacdec.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <taglib/tiostream.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "audio/mp4_demuxer.h"
 
 namespace fs = std::filesystem;
 
 namespace chksound::audio {
 namespace {
 
-class Mpg123AudioReader : public AudioReader {
+std::atomic<bool> drop_cache{false};
+std::atomic<bool> memory_map{true};
+
+// MPG123_DOWN_SAMPLE: 0 for the full rate, 1 for 2:1 or 2 for 4:1.
+std::atomic<long> down_sample{0};  // NOLINT(runtime/int)
+
+// Read-only mapping of a whole file, which the decoders read without issuing
+// a read(2) for every frame: mpg123 through its reader hooks, faad2 from the
+// access units located in place.
+class MappedFile {
  public:
-  explicit Mpg123AudioReader(const std::filesystem::path& path)
-      : handle_{}, cursor_{}, limit_{} {
-    int err;
-    auto handle = mpg123_new(nullptr, &err);
-    if (handle == nullptr)
-      return;
+  MappedFile() : fd_{-1}, data_{}, size_{}, position_{} {}
 
-    do {
-      err = mpg123_open(handle, path.c_str());
-      if (err != MPG123_OK)
-        break;
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<unsigned char*>(data_), size_);
+      data_ = nullptr;
+    }
 
-      err = mpg123_getformat(handle, &rate_, &channels_, &encoding_);
-      if (err != MPG123_OK)
-        break;
+    if (fd_ != -1) {
+      // Leaves the page cache to the other processes on the system.
+      if (drop_cache.load(std::memory_order_relaxed))
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+
+      close(fd_);
+      fd_ = -1;
+    }
+  }
 
-      if ((encoding_ & MPG123_ENC_FLOAT) != 0)
+  bool Open(const char* path) {
+    fd_ = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1)
+      return false;
+
+    struct stat status;
+    if (fstat(fd_, &status) != 0 || status.st_size <= 0)
+      return false;
+
+    auto data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data == MAP_FAILED)
+      return false;
+
+    madvise(data, status.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const unsigned char*>(data);
+    size_ = status.st_size;
+    return true;
+  }
+
+  static ssize_t Read(void* handle, void* buffer, size_t size) {
+    auto file = static_cast<MappedFile*>(handle);
+    auto length = std::min(size, file->size_ - file->position_);
+    memcpy(buffer, file->data_ + file->position_, length);
+    file->position_ += length;
+    return length;
+  }
+
+  static off_t Seek(void* handle, off_t offset, int whence) {
+    auto file = static_cast<MappedFile*>(handle);
+    off_t base;
+    switch (whence) {
+      case SEEK_SET:
+        base = 0;
         break;
 
-      if ((encoding_ & MPG123_ENC_SIGNED) == 0)
+      case SEEK_CUR:
+        base = file->position_;
         break;
 
-      if (encoding_ & MPG123_ENC_8)
-        bits_ = 8;
-      else if (encoding_ & MPG123_ENC_16)
-        bits_ = 16;
-      else if (encoding_ & MPG123_ENC_24)
-        bits_ = 24;
-#if 0
-      else if (encoding_ & MPG123_ENC_32)
-        bits_ = 32;
-#endif
-      else
+      case SEEK_END:
+        base = file->size_;
         break;
 
-      range_ = 1 << (bits_ - 1);
+      default:
+        return -1;
+    }
+
+    if (offset < -base || static_cast<off_t>(file->size_) - base < offset)
+      return -1;
 
-      handle_ = handle;
-      return;
-    } while (false);
+    file->position_ = base + offset;
+    return file->position_;
+  }
 
-    mpg123_delete(handle);
+  const unsigned char* data() const {
+    return data_;
   }
 
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  int fd_;
+  const unsigned char* data_;
+  size_t size_;
+  size_t position_;
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// Lets mpg123 read through a TagLib::IOStream.
+ssize_t ReadStream(void* handle, void* buffer, size_t size) {
+  auto data = static_cast<TagLib::IOStream*>(handle)->readBlock(size);
+  memcpy(buffer, data.data(), data.size());
+  return data.size();
+}
+
+off_t SeekStream(void* handle, off_t offset, int whence) {
+  auto stream = static_cast<TagLib::IOStream*>(handle);
+  off_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+
+    case SEEK_CUR:
+      base = stream->tell();
+      break;
+
+    case SEEK_END:
+      base = stream->length();
+      break;
+
+    default:
+      return -1;
+  }
+
+  // IOStream::seek reports no error, so the target is checked here.
+  if (offset < -base || stream->length() - base < offset)
+    return -1;
+
+  stream->seek(base + offset);
+  return stream->tell();
+}
+
+class Mpg123AudioReader : public AudioReader {
+ public:
+  Mpg123AudioReader()
+      : handle_{mpg123_new(nullptr, nullptr)}, cursor_{}, limit_{} {}
+
   ~Mpg123AudioReader() override {
     if (handle_ != nullptr) {
       mpg123_delete(handle_);
@@ -62,31 +173,97 @@ class Mpg123AudioReader : public AudioReader {
     }
   }
 
-  bool Read(double* buffer) override {
-    if (cursor_ == limit_) {
-      off_t offset;
-      size_t bytes;
-      auto err = mpg123_decode_frame(handle_, &offset, &cursor_, &bytes);
-      if (err != MPG123_OK)
+  bool Open(const fs::path& path) {
+    if (!Configure())
+      return false;
+
+    if (!memory_map.load(std::memory_order_relaxed)) {
+      if (mpg123_open(handle_, path.c_str()) != MPG123_OK)
         return false;
 
-      limit_ = cursor_ + bytes;
+      return Initialize();
     }
 
-    while (cursor_ < limit_) {
-      for (auto channel = 0; channel < channels_; ++channel) {
-        int data = cursor_[bits_ / 8 - 1] & 0x80 ? 0xFFFFFFFF << bits_ : 0;
-        for (auto b = 0; b < bits_; b += 8) {
-          data |= *cursor_++ << b;
-        }
+    if (!input_.Open(path.c_str()))
+      return false;
+
+    auto err = mpg123_replace_reader_handle(handle_, MappedFile::Read,
+                                            MappedFile::Seek, nullptr);
+    if (err != MPG123_OK || mpg123_open_handle(handle_, &input_) != MPG123_OK)
+      return false;
+
+    return Initialize();
+  }
 
-        buffer[channel] = data / range_;
+  // Reads through |stream|, which is read from its start and must outlive the
+  // reader.
+  bool Open(TagLib::IOStream* stream) {
+    if (!Configure())
+      return false;
+
+    stream->seek(0);
+    auto err = mpg123_replace_reader_handle(handle_, ReadStream, SeekStream,
+                                            nullptr);
+    if (err != MPG123_OK || mpg123_open_handle(handle_, stream) != MPG123_OK)
+      return false;
+
+    return Initialize();
+  }
+
+  size_t Read(double* buffer, size_t frames) override {
+    const auto frame_size = static_cast<size_t>(bits_ / 8 * channels_);
+
+    size_t count = 0;
+    while (count < frames) {
+      if (cursor_ == limit_) {
+        off_t offset;
+        size_t bytes;
+        auto err = mpg123_decode_frame(handle_, &offset, &cursor_, &bytes);
+        if (err != MPG123_OK)
+          break;
+
+        limit_ = cursor_ + bytes;
+        continue;
       }
 
-      return true;
+      auto available = static_cast<size_t>(limit_ - cursor_) / frame_size;
+      auto length = std::min(frames - count, available);
+      if (length == 0)
+        break;
+
+      Convert(cursor_, buffer + count * channels_, length * channels_);
+      cursor_ += length * frame_size;
+      count += length;
     }
 
-    return false;
+    return count;
+  }
+
+  uint64_t GetLength(uint64_t exact_from) override {
+    // Without a scan, the length of a VBR stream lacking a Xing header is
+    // estimated from its first frames. The scan reads the whole stream, so it
+    // is done only if the estimate comes near |exact_from|; it also fills the
+    // seek index.
+    auto length = mpg123_length(handle_);
+    if (length < 0)
+      return 0;
+
+    if (static_cast<uint64_t>(length) < exact_from / 2)
+      return length;
+
+    if (mpg123_scan(handle_) != MPG123_OK)
+      return 0;
+
+    length = mpg123_length(handle_);
+    return 0 < length ? length : 0;
+  }
+
+  bool Seek(uint64_t frame) override {
+    if (mpg123_seek(handle_, frame, SEEK_SET) < 0)
+      return false;
+
+    cursor_ = limit_ = nullptr;
+    return true;
   }
 
   double GetSamplingRate() const override {
@@ -97,11 +274,111 @@ class Mpg123AudioReader : public AudioReader {
     return channels_;
   }
 
-  bool valid() const {
-    return handle_ != nullptr;
+ private:
+  bool Configure() {
+    if (handle_ == nullptr)
+      return false;
+
+    mpg123_param(handle_, MPG123_DOWN_SAMPLE,
+                 down_sample.load(std::memory_order_relaxed), 0.0);
+    SelectFormat();
+    return true;
   }
 
- private:
+  // Asks for floating-point output if the decoder supports it, so that the
+  // samples need no reconstruction and are not clipped to full scale.
+  void SelectFormat() {
+    const int* encodings;
+    size_t count;
+    mpg123_encodings(&encodings, &count);
+
+    for (auto encoding : {MPG123_ENC_FLOAT_64, MPG123_ENC_FLOAT_32}) {
+      if (std::find(encodings, encodings + count, encoding) ==
+          encodings + count)
+        continue;
+
+      const long* rates;  // NOLINT(runtime/int)
+      mpg123_rates(&rates, &count);
+
+      mpg123_format_none(handle_);
+      for (size_t i = 0; i < count; ++i)
+        mpg123_format(handle_, rates[i], MPG123_MONO | MPG123_STEREO,
+                      encoding);
+      return;
+    }
+  }
+
+  bool Initialize() {
+    auto err = mpg123_getformat(handle_, &rate_, &channels_, &encoding_);
+    if (err != MPG123_OK)
+      return false;
+
+    switch (encoding_) {
+      case MPG123_ENC_FLOAT_64:
+      case MPG123_ENC_FLOAT_32:
+      case MPG123_ENC_SIGNED_8:
+      case MPG123_ENC_SIGNED_16:
+      case MPG123_ENC_SIGNED_24:
+      case MPG123_ENC_SIGNED_32:
+        break;
+
+      default:
+        return false;
+    }
+
+    bits_ = mpg123_encsize(encoding_) * 8;
+    range_ = std::ldexp(1.0, bits_ - 1);
+
+    return true;
+  }
+
+  void Convert(const unsigned char* input, double* output,
+               size_t samples) const {
+    switch (encoding_) {
+      case MPG123_ENC_FLOAT_64:
+        memcpy(output, input, samples * sizeof(*output));
+        break;
+
+      case MPG123_ENC_FLOAT_32:
+        for (size_t i = 0; i < samples; ++i, input += 4) {
+          float data;
+          memcpy(&data, input, sizeof(data));
+          output[i] = data;
+        }
+        break;
+
+      case MPG123_ENC_SIGNED_8:
+        for (size_t i = 0; i < samples; ++i)
+          output[i] = static_cast<int8_t>(input[i]) / range_;
+        break;
+
+      case MPG123_ENC_SIGNED_16:
+        for (size_t i = 0; i < samples; ++i, input += 2) {
+          int16_t data;
+          memcpy(&data, input, sizeof(data));
+          output[i] = data / range_;
+        }
+        break;
+
+      case MPG123_ENC_SIGNED_24:
+        for (size_t i = 0; i < samples; ++i, input += 3) {
+          int32_t data = input[0] | input[1] << 8 |
+                         static_cast<int8_t>(input[2]) * (1 << 16);
+          output[i] = data / range_;
+        }
+        break;
+
+      case MPG123_ENC_SIGNED_32:
+        for (size_t i = 0; i < samples; ++i, input += 4) {
+          int32_t data;
+          memcpy(&data, input, sizeof(data));
+          output[i] = data / range_;
+        }
+        break;
+    }
+  }
+
+  MappedFile input_;
   mpg123_handle* handle_;
   long rate_;  // NOLINT(runtime/int)
   int channels_;
@@ -116,14 +393,276 @@ class Mpg123AudioReader : public AudioReader {
   Mpg123AudioReader& operator=(const Mpg123AudioReader&) = delete;
 };
 
-}  // namespace
+// Decodes the AAC track of an MP4 file with faad2, which is given the access
+// units located by Mp4Demuxer.
+class FaadAudioReader : public AudioReader {
+ public:
+  FaadAudioReader()
+      : handle_{NeAACDecOpen()},
+        rate_{},
+        channels_{},
+        frame_length_{},
+        next_{},
+        skip_{},
+        failed_{},
+        cursor_{},
+        limit_{} {}
 
-std::unique_ptr<AudioReader> OpenAudio(const std::filesystem::path& path) {
-  auto reader = std::make_unique<Mpg123AudioReader>(path);
-  if (reader == nullptr || !reader->valid())
+  ~FaadAudioReader() override {
+    if (handle_ != nullptr) {
+      NeAACDecClose(handle_);
+      handle_ = nullptr;
+    }
+  }
+
+  bool Open(const fs::path& path) {
+    if (handle_ == nullptr || !input_.Open(path.c_str()) ||
+        !demuxer_.Open(input_.data(), input_.size()))
+      return false;
+
+    // Samples as they come out of the synthesis, neither clipped nor mixed
+    // down.
+    auto config = NeAACDecGetCurrentConfiguration(handle_);
+    config->outputFormat = FAAD_FMT_DOUBLE;
+    config->downMatrix = 0;
+    if (!NeAACDecSetConfiguration(handle_, config))
+      return false;
+
+    std::vector<unsigned char> specific_config = demuxer_.config();
+    unsigned long rate;  // NOLINT(runtime/int)
+    unsigned char channels;
+    // Returns -1 on error, as a char which may be unsigned.
+    auto result = NeAACDecInit2(handle_, specific_config.data(),
+                                specific_config.size(), &rate, &channels);
+    if (static_cast<signed char>(result) < 0)
+      return false;
+
+    // Parametric stereo and SBR show in the output only, which starts with the
+    // second access unit.
+    while (cursor_ == limit_) {
+      if (!Decode())
+        return false;
+    }
+
+    return true;
+  }
+
+  size_t Read(double* buffer, size_t frames) override {
+    size_t count = 0;
+    while (count < frames) {
+      if (cursor_ == limit_) {
+        if (!Decode())
+          break;
+
+        continue;
+      }
+
+      auto available = static_cast<size_t>(limit_ - cursor_) / channels_;
+      if (0 < skip_) {
+        auto length = static_cast<size_t>(std::min<uint64_t>(skip_, available));
+        cursor_ += length * channels_;
+        skip_ -= length;
+        continue;
+      }
+
+      auto length = std::min(frames - count, available);
+      memcpy(buffer + count * channels_, cursor_,
+             length * channels_ * sizeof(*buffer));
+      cursor_ += length * channels_;
+      count += length;
+    }
+
+    return count;
+  }
+
+  uint64_t GetLength(uint64_t exact_from) override {
+    // The first access unit is not output.
+    auto length = demuxer_.duration() * rate_ / demuxer_.timescale();
+    return frame_length_ < length ? length - frame_length_ : 0;
+  }
+
+  bool Seek(uint64_t frame) override {
+    // The output of access unit n starts at frame (n - 1) * frame_length_ and
+    // depends on the units before it through the overlap of the transform and
+    // the state of SBR, so decoding starts kPreRoll units earlier and their
+    // output is dropped.
+    auto unit = frame / frame_length_ + 1;
+    auto start = kPreRoll < unit ? unit - kPreRoll : 0;
+    if (demuxer_.GetSampleCount() <= start)
+      return false;
+
+    NeAACDecPostSeekReset(handle_, static_cast<long>(start));  // NOLINT
+    next_ = start;
+    failed_ = false;
+    skip_ = frame - (start == 0 ? 0 : (start - 1) * frame_length_);
+    cursor_ = limit_ = nullptr;
+    return true;
+  }
+
+  bool HasFailed() const override {
+    return failed_;
+  }
+
+  double GetSamplingRate() const override {
+    return rate_;
+  }
+
+  int GetChannels() const override {
+    return channels_;
+  }
+
+  std::vector<uint32_t> GetChannelMap() const override {
+    std::vector<uint32_t> channel_map;
+    for (auto position : positions_) {
+      switch (position) {
+        case FRONT_CHANNEL_CENTER:
+          channel_map.push_back(kFrontCenter);
+          break;
+
+        case FRONT_CHANNEL_LEFT:
+          channel_map.push_back(kFrontLeft);
+          break;
+
+        case FRONT_CHANNEL_RIGHT:
+          channel_map.push_back(kFrontRight);
+          break;
+
+        case SIDE_CHANNEL_LEFT:
+          channel_map.push_back(kSideLeft);
+          break;
+
+        case SIDE_CHANNEL_RIGHT:
+          channel_map.push_back(kSideRight);
+          break;
+
+        case BACK_CHANNEL_LEFT:
+          channel_map.push_back(kBackLeft);
+          break;
+
+        case BACK_CHANNEL_RIGHT:
+          channel_map.push_back(kBackRight);
+          break;
+
+        case BACK_CHANNEL_CENTER:
+          channel_map.push_back(kBackCenter);
+          break;
+
+        case LFE_CHANNEL:
+          channel_map.push_back(kLowFrequency);
+          break;
+
+        default:
+          channel_map.push_back(0);
+          break;
+      }
+    }
+
+    return channel_map;
+  }
+
+ private:
+  // Access units decoded ahead of the one a seek lands in.
+  static constexpr uint64_t kPreRoll = 3;
+
+  // Decodes the next access unit into |cursor_| and |limit_|, which are left
+  // empty for the first one. Returns false at the end of the track or on
+  // error, which is then recorded in |failed_| and ends the track.
+  bool Decode() {
+    const unsigned char* data;
+    size_t size;
+    if (failed_ || !demuxer_.GetSample(next_, &data, &size))
+      return false;
+
+    ++next_;
+
+    // The buffer is not modified despite its type.
+    NeAACDecFrameInfo info;
+    auto samples = static_cast<double*>(NeAACDecDecode(
+        handle_, &info, const_cast<unsigned char*>(data), size));
+    if (info.error != 0) {
+      failed_ = true;
+      return false;
+    }
+
+    if (info.samples != 0) {
+      if (channels_ == 0) {
+        rate_ = info.samplerate;
+        channels_ = info.channels;
+        frame_length_ = info.samples / info.channels;
+        positions_.assign(info.channel_position,
+                          info.channel_position + info.channels);
+      } else if (info.channels != channels_ || info.samplerate != rate_) {
+        failed_ = true;
+        return false;
+      }
+    }
+
+    cursor_ = samples;
+    limit_ = samples + info.samples;
+    return true;
+  }
+
+  MappedFile input_;
+  Mp4Demuxer demuxer_;
+  NeAACDecHandle handle_;
+  unsigned long rate_;  // NOLINT(runtime/int)
+  int channels_;
+  std::vector<unsigned char> positions_;  // of faad2, one per channel.
+
+  uint64_t frame_length_;  // number of frames output per access unit.
+  size_t next_;            // index of the access unit to be decoded next.
+  uint64_t skip_;          // number of frames to drop after a seek.
+  bool failed_;
+
+  const double* cursor_;
+  const double* limit_;
+
+  FaadAudioReader(const FaadAudioReader&) = delete;
+  FaadAudioReader& operator=(const FaadAudioReader&) = delete;
+};
+
+template <class T, class Source>
+std::unique_ptr<AudioReader> Open(const Source& source) {
+  auto reader = std::make_unique<T>();
+  if (!reader->Open(source))
     return nullptr;
 
   return reader;
 }
 
+}  // namespace
+
+std::unique_ptr<AudioReader> OpenAudio(const std::filesystem::path& path) {
+  if (path.extension() == ".m4a")
+    return Open<FaadAudioReader>(path);
+
+  return Open<Mpg123AudioReader>(path);
+}
+
+bool CanShareStream() {
+  return true;
+}
+
+std::unique_ptr<AudioReader> OpenAudio(TagLib::IOStream* stream) {
+  // The demuxer locates the access units in a mapping of the file.
+  fs::path path(stream->name());
+  if (path.extension() == ".m4a")
+    return Open<FaadAudioReader>(path);
+
+  return Open<Mpg123AudioReader>(stream);
+}
+
+void SetDropCache(bool enable) {
+  drop_cache.store(enable, std::memory_order_relaxed);
+}
+
+void SetMemoryMap(bool enable) {
+  memory_map.store(enable, std::memory_order_relaxed);
+}
+
+void SetDownSample(int factor) {
+  down_sample.store(factor == 4 ? 2 : factor == 2 ? 1 : 0,
+                    std::memory_order_relaxed);
+}
+
 }  // namespace chksound::audio
@@ -1,8 +1,14 @@
 // Copyright (c) 2020 dacci.org
 
+#include <AudioToolbox/AudioFile.h>
+#include <AudioToolbox/AudioFormat.h>
 #include <AudioToolbox/ExtendedAudioFile.h>
+#include <strings.h>
+#include <taglib/tiostream.h>
 
+#include <cstring>
 #include <memory>
+#include <vector>
 
 #include "audio/audio_reader.h"
 
@@ -11,35 +17,176 @@ namespace {
 
 namespace fs = ::std::filesystem;
 
+// Lets AudioFile read through a TagLib::IOStream.
+OSStatus ReadStream(void* client, SInt64 position, UInt32 size, void* buffer,
+                    UInt32* actual) {
+  auto stream = static_cast<TagLib::IOStream*>(client);
+  stream->seek(position);
+  auto data = stream->readBlock(size);
+  memcpy(buffer, data.data(), data.size());
+  *actual = data.size();
+  return noErr;
+}
+
+SInt64 GetStreamSize(void* client) {
+  return static_cast<TagLib::IOStream*>(client)->length();
+}
+
 class MacAudioReader : public AudioReader {
  public:
-  explicit MacAudioReader(const fs::path& path) : file_{}, format_{} {
+  MacAudioReader() : audio_file_{}, file_{}, format_{} {}
+
+  virtual ~MacAudioReader() {
+    if (file_) {
+      ExtAudioFileDispose(file_);
+      file_ = nullptr;
+    }
+
+    if (audio_file_) {
+      AudioFileClose(audio_file_);
+      audio_file_ = nullptr;
+    }
+  }
+
+  bool Open(const fs::path& path) {
     auto path_string = CFStringCreateWithCString(
         kCFAllocatorDefault, path.c_str(), kCFStringEncodingUTF8);
     if (!path_string)
-      return;
+      return false;
 
     auto path_url = CFURLCreateWithFileSystemPath(
         kCFAllocatorDefault, path_string, kCFURLPOSIXPathStyle, false);
     CFRelease(path_string);
     if (!path_url)
-      return;
+      return false;
 
     ExtAudioFileRef new_file;
     auto err = ExtAudioFileOpenURL(path_url, &new_file);
     CFRelease(path_url);
     if (err)
-      return;
+      return false;
+
+    return Initialize(new_file);
+  }
+
+  // Reads through |stream|, which must outlive the reader.
+  bool Open(TagLib::IOStream* stream) {
+    // Without a hint, AudioFile may not recognize an MPEG stream. File names
+    // are case-insensitive on macOS by default.
+    auto extension = fs::path(stream->name()).extension();
+    auto type = strcasecmp(extension.c_str(), ".mp3") == 0
+                    ? kAudioFileMP3Type
+                    : kAudioFileM4AType;
+    auto err = AudioFileOpenWithCallbacks(stream, ReadStream, nullptr,
+                                          GetStreamSize, nullptr, type,
+                                          &audio_file_);
+    if (err)
+      return false;
+
+    ExtAudioFileRef new_file;
+    err = ExtAudioFileWrapAudioFileID(audio_file_, false, &new_file);
+    if (err)
+      return false;
+
+    return Initialize(new_file);
+  }
+
+  size_t Read(double* buffer, size_t frames) override {
+    uint32_t count = static_cast<uint32_t>(frames);
+    AudioBufferList buffers{1};
+    buffers.mBuffers[0].mNumberChannels = format_.mChannelsPerFrame;
+    buffers.mBuffers[0].mDataByteSize = format_.mBytesPerFrame * count;
+    buffers.mBuffers[0].mData = buffer;
+    auto err = ExtAudioFileRead(file_, &count, &buffers);
+    if (err)
+      return 0;
+
+    return count;
+  }
+
+  uint64_t GetLength(uint64_t exact_from) override {
+    SInt64 length;
+    uint32_t size = sizeof(length);
+    auto err = ExtAudioFileGetProperty(
+        file_, kExtAudioFileProperty_FileLengthFrames, &size, &length);
+    if (err || length < 0)
+      return 0;
+
+    return length;
+  }
+
+  bool Seek(uint64_t frame) override {
+    return ExtAudioFileSeek(file_, frame) == noErr;
+  }
+
+  double GetSamplingRate() const override {
+    return format_.mSampleRate;
+  }
+
+  int GetChannels() const override {
+    return format_.mChannelsPerFrame;
+  }
+
+  std::vector<uint32_t> GetChannelMap() const override {
+    UInt32 size;
+    auto err = ExtAudioFileGetPropertyInfo(
+        file_, kExtAudioFileProperty_FileChannelLayout, &size, nullptr);
+    if (err)
+      return AudioReader::GetChannelMap();
+
+    std::vector<char> buffer(size);
+    auto layout = reinterpret_cast<AudioChannelLayout*>(buffer.data());
+    err = ExtAudioFileGetProperty(
+        file_, kExtAudioFileProperty_FileChannelLayout, &size, layout);
+    if (err)
+      return AudioReader::GetChannelMap();
+
+    // Expand a layout given by a tag or a bitmap into channel descriptions.
+    if (layout->mChannelLayoutTag ==
+        kAudioChannelLayoutTag_UseChannelBitmap) {
+      return AudioReader::GetChannelMap(layout->mChannelBitmap, GetChannels());
+    } else if (layout->mChannelLayoutTag !=
+               kAudioChannelLayoutTag_UseChannelDescriptions) {
+      auto tag = layout->mChannelLayoutTag;
+      err = AudioFormatGetPropertyInfo(kAudioFormatProperty_ChannelLayoutForTag,
+                                       sizeof(tag), &tag, &size);
+      if (err)
+        return AudioReader::GetChannelMap();
+
+      buffer.resize(size);
+      layout = reinterpret_cast<AudioChannelLayout*>(buffer.data());
+      err = AudioFormatGetProperty(kAudioFormatProperty_ChannelLayoutForTag,
+                                   sizeof(tag), &tag, &size, layout);
+      if (err)
+        return AudioReader::GetChannelMap();
+    }
+
+    if (layout->mNumberChannelDescriptions != format_.mChannelsPerFrame)
+      return AudioReader::GetChannelMap();
+
+    // Labels from Left to RightSurroundDirect match the bits of the bitmap.
+    std::vector<uint32_t> map;
+    for (UInt32 i = 0; i < layout->mNumberChannelDescriptions; ++i) {
+      auto label = layout->mChannelDescriptions[i].mChannelLabel;
+      if (kAudioChannelLabel_Left <= label &&
+          label <= kAudioChannelLabel_RightSurroundDirect)
+        map.push_back(1u << (label - kAudioChannelLabel_Left));
+      else
+        map.push_back(0);
+    }
 
+    return map;
+  }
+
+ private:
+  bool Initialize(ExtAudioFileRef new_file) {
     do {
       uint32_t size = sizeof(format_);
-      err = ExtAudioFileGetProperty(
+      auto err = ExtAudioFileGetProperty(
           new_file, kExtAudioFileProperty_FileDataFormat, &size, &format_);
       if (err)
         break;
 
-      frames_per_packet_ = format_.mFramesPerPacket;
-
       format_.mFormatID = kAudioFormatLinearPCM;
       format_.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
       format_.mFramesPerPacket = 1;
@@ -54,73 +201,17 @@ class MacAudioReader : public AudioReader {
         break;
 
       file_ = new_file;
-      return;
+      return true;
     } while (false);
 
     ExtAudioFileDispose(new_file);
-  }
-
-  virtual ~MacAudioReader() {
-    if (file_) {
-      ExtAudioFileDispose(file_);
-      file_ = nullptr;
-    }
-  }
-
-  bool Read(double* buffer) override {
-    if (!buffer_) {
-      buffer_ = std::make_unique<double[]>(format_.mChannelsPerFrame *
-                                           frames_per_packet_);
-      cursor_ = buffer_.get();
-      limit_ = cursor_;
-    }
-
-    if (cursor_ == limit_) {
-      uint32_t frames = frames_per_packet_;
-      AudioBufferList buffers{1};
-      buffers.mBuffers[0].mNumberChannels = format_.mChannelsPerFrame;
-      buffers.mBuffers[0].mDataByteSize = format_.mBytesPerFrame * frames;
-      buffers.mBuffers[0].mData = buffer_.get();
-      auto err = ExtAudioFileRead(file_, &frames, &buffers);
-      if (err)
-        return false;
-
-      cursor_ = buffer_.get();
-      limit_ = cursor_ + format_.mChannelsPerFrame * frames;
-    }
-
-    while (cursor_ < limit_) {
-      for (auto channel = 0U; channel < format_.mChannelsPerFrame; ++channel) {
-        buffer[channel] = *(cursor_++);
-      }
-
-      return true;
-    }
-
     return false;
   }
 
-  double GetSamplingRate() const override {
-    return format_.mSampleRate;
-  }
-
-  int GetChannels() const override {
-    return format_.mChannelsPerFrame;
-  }
-
-  bool valid() const {
-    return file_ != nullptr;
-  }
-
- private:
+  AudioFileID audio_file_;
   ExtAudioFileRef file_;
   AudioStreamBasicDescription format_;
 
-  uint32_t frames_per_packet_;
-  std::unique_ptr<double[]> buffer_;
-  double* cursor_;
-  double* limit_;
-
   MacAudioReader(const MacAudioReader&) = delete;
   MacAudioReader& operator=(const MacAudioReader&) = delete;
 };
@@ -128,11 +219,35 @@ class MacAudioReader : public AudioReader {
 }  // namespace
 
 std::unique_ptr<AudioReader> OpenAudio(const fs::path& path) {
-  auto reader = std::make_unique<MacAudioReader>(path);
-  if (!reader->valid())
+  auto reader = std::make_unique<MacAudioReader>();
+  if (!reader->Open(path))
+    return nullptr;
+
+  return reader;
+}
+
+bool CanShareStream() {
+  return true;
+}
+
+std::unique_ptr<AudioReader> OpenAudio(TagLib::IOStream* stream) {
+  auto reader = std::make_unique<MacAudioReader>();
+  if (!reader->Open(stream))
     return nullptr;
 
   return reader;
 }
 
+void SetDropCache(bool enable) {
+  // Not supported.
+}
+
+void SetMemoryMap(bool enable) {
+  // Not supported.
+}
+
+void SetDownSample(int factor) {
+  // Not supported.
+}
+
 }  // namespace chksound::audio
@@ -6,8 +6,13 @@
 #include <mfidl.h>
 #include <mfreadwrite.h>
 
+#include <taglib/tiostream.h>
 #include <wrl/client.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
 namespace chksound::audio {
 namespace {
 
@@ -17,7 +22,13 @@ using ::Microsoft::WRL::ComPtr;
 class WindowsAudioReader : public AudioReader {
  public:
   explicit WindowsAudioReader(const fs::path& path)
-      : channels_{}, sampling_rate_{}, bits_{}, range_{}, cursor_{}, limit_{} {
+      : channels_{},
+        channel_mask_{},
+        sampling_rate_{},
+        bits_{},
+        range_{},
+        cursor_{},
+        limit_{} {
     auto result = MFCreateSourceReaderFromURL(path.c_str(), nullptr,
                                               reader_.GetAddressOf());
     if (FAILED(result))
@@ -67,14 +78,67 @@ class WindowsAudioReader : public AudioReader {
 
       range_ = 1 << (bits_ - 1);
 
+      channel_mask_ =
+          MFGetAttributeUINT32(media_type.Get(), MF_MT_AUDIO_CHANNEL_MASK, 0);
+
       return;
     } while (false);
 
     reader_->Release();
   }
 
-  bool Read(double* buffer) override {
-    while (cursor_ == limit_) {
+  size_t Read(double* buffer, size_t frames) override {
+    const auto frame_size = static_cast<size_t>(bits_ / 8 * channels_);
+
+    size_t count = 0;
+    while (count < frames) {
+      if (cursor_ == limit_) {
+        if (!ReadSample())
+          break;
+
+        continue;
+      }
+
+      auto available = static_cast<size_t>(limit_ - cursor_) / frame_size;
+      auto length = std::min(frames - count, available);
+      if (length == 0)
+        break;
+
+      Convert(cursor_, buffer + count * channels_, length * channels_);
+      cursor_ += length * frame_size;
+      count += length;
+    }
+
+    return count;
+  }
+
+  double GetSamplingRate() const override {
+    return sampling_rate_;
+  }
+
+  int GetChannels() const override {
+    return channels_;
+  }
+
+  std::vector<uint32_t> GetChannelMap() const override {
+    if (channel_mask_ == 0)
+      return AudioReader::GetChannelMap();
+
+    return AudioReader::GetChannelMap(channel_mask_, channels_);
+  }
+
+  bool valid() const {
+    return reader_ != nullptr;
+  }
+
+ private:
+  bool ReadSample() {
+    if (buffer_ != nullptr) {
+      buffer_->Unlock();
+      buffer_.Reset();
+    }
+
+    while (true) {
       DWORD flags;
       auto result = reader_->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0,
                                         nullptr, &flags, nullptr,
@@ -93,44 +157,44 @@ class WindowsAudioReader : public AudioReader {
 
       DWORD length;
       result = buffer_->Lock(&cursor_, nullptr, &length);
-      if (FAILED(result))
+      if (FAILED(result)) {
+        buffer_.Reset();
         return false;
-
-      limit_ = cursor_ + length;
-      break;
-    }
-
-    while (cursor_ < limit_) {
-      for (UINT32 channel = 0; channel < channels_; ++channel) {
-        int data = cursor_[bits_ / 8 - 1] & 0x80 ? 0xFFFFFFFF << bits_ : 0;
-        for (UINT32 b = 0; b < bits_; b += 8) {
-          data |= *cursor_++ << b;
-        }
-
-        buffer[channel] = data / range_;
       }
 
+      limit_ = cursor_ + length;
       return true;
     }
-
-    return false;
   }
 
-  double GetSamplingRate() const override {
-    return sampling_rate_;
-  }
+  void Convert(const BYTE* input, double* output, size_t samples) const {
+    switch (bits_) {
+      case 8:
+        for (size_t i = 0; i < samples; ++i)
+          output[i] = static_cast<int8_t>(input[i]) / range_;
+        break;
 
-  int GetChannels() const override {
-    return channels_;
-  }
+      case 16:
+        for (size_t i = 0; i < samples; ++i, input += 2) {
+          int16_t data;
+          memcpy(&data, input, sizeof(data));
+          output[i] = data / range_;
+        }
+        break;
 
-  bool valid() const {
-    return reader_ != nullptr;
+      case 24:
+        for (size_t i = 0; i < samples; ++i, input += 3) {
+          int32_t data = input[0] | input[1] << 8 |
+                         static_cast<int8_t>(input[2]) * (1 << 16);
+          output[i] = data / range_;
+        }
+        break;
+    }
   }
 
- private:
   ComPtr<IMFSourceReader> reader_;
   UINT32 channels_;
+  UINT32 channel_mask_;
   UINT32 sampling_rate_;
   UINT32 bits_;
   double range_;
@@ -154,4 +218,25 @@ std::unique_ptr<AudioReader> OpenAudio(const fs::path& path) {
   return reader;
 }
 
+bool CanShareStream() {
+  return false;
+}
+
+std::unique_ptr<AudioReader> OpenAudio(TagLib::IOStream* stream) {
+  // Media Foundation opens the file by itself.
+  return OpenAudio(fs::path(static_cast<const wchar_t*>(stream->name())));
+}
+
+void SetDropCache(bool enable) {
+  // Not supported.
+}
+
+void SetMemoryMap(bool enable) {
+  // Not supported.
+}
+
+void SetDownSample(int factor) {
+  // Not supported.
+}
+
 }  // namespace chksound::audio
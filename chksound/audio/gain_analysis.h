@@ -3,8 +3,14 @@
 #ifndef CHKSOUND_AUDIO_GAIN_ANALYSIS_H_
 #define CHKSOUND_AUDIO_GAIN_ANALYSIS_H_
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <mutex>         // NOLINT(build/c++11)
+#include <numeric>
 #include <shared_mutex>  // NOLINT(build/include_order)
+#include <utility>
+#include <vector>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -18,60 +24,343 @@
 #pragma warning(pop)
 #endif
 
+#include "audio/audio_reader.h"
+#include "audio/true_peak.h"
+
 namespace chksound::audio {
 
+// Snapshot of the gating histogram of a GainAnalysis, which can be stored and
+// merged into a GainAggregator later without analyzing the stream again.
+struct GainHistogram {
+  double mean;         // cumulative moving average of the gated blocks.
+  uint64_t count;      // number of gated blocks.
+  double max;          // maximum block power.
+  std::vector<std::pair<uint32_t, uint32_t>> bins;  // non-empty bins only.
+
+  // Adds the blocks of |other| as lib1770_stats_merge does, keeping the bins
+  // sorted.
+  void Merge(const GainHistogram& other) {
+    if (max < other.max)
+      max = other.max;
+
+    auto total = count + other.count;
+    if (total == 0)
+      return;
+
+    mean = static_cast<double>(count) / total * mean +
+           static_cast<double>(other.count) / total * other.mean;
+    count = total;
+
+    // The bins both hold are counted first, so that the merged bins can be
+    // written in place from the back, past the bins not yet read.
+    size_t common = 0;
+    for (size_t i = 0, j = 0; i < bins.size() && j < other.bins.size();) {
+      if (bins[i].first < other.bins[j].first) {
+        ++i;
+      } else if (other.bins[j].first < bins[i].first) {
+        ++j;
+      } else {
+        ++common;
+        ++i;
+        ++j;
+      }
+    }
+
+    auto i = bins.size();
+    auto j = other.bins.size();
+    auto k = i + j - common;
+    bins.resize(k);
+    while (0 < j) {
+      auto bin = other.bins[j - 1];
+      if (0 < i && bin.first < bins[i - 1].first) {
+        bins[--k] = bins[--i];
+        continue;
+      }
+
+      if (0 < i && bins[i - 1].first == bin.first)
+        bin.second += bins[--i].second;
+
+      bins[--k] = bin;
+      --j;
+    }
+  }
+};
+
+// Measures the loudness of a single stream. An instance is meant to be fed by
+// a single thread and does no locking of its own; once the stream has been
+// consumed, it can be handed over to GainAggregator::Merge.
 class GainAnalysis {
  public:
-  GainAnalysis(double sampling_rate, int channels)
-      : channels_{channels},
+  // How Finalize treats the blocks which the stream ends in the middle of.
+  enum class Tail {
+    kDrop,  // drops them, as ITU BS.1770 does.
+    kPad,   // completes them with silence, so that short tracks are measured.
+  };
+
+  // Measures taken on request besides the loudness and the sample peak,
+  // since they cost more than those.
+  enum Measure {
+    kTruePeak = 1 << 0,  // true peak of ITU BS.1770-4.
+
+    // Loudness range of EBU Tech 3342 and maximum short-term loudness, from
+    // 3 s blocks starting every 100 ms.
+    kLoudnessRange = 1 << 1,
+  };
+
+  static constexpr size_t kMaxChannels = LIB1770_MAX_CHANNELS;
+
+  // |channel_map| holds the Speaker position of each channel, which must not
+  // be more than kMaxChannels. |measures| is a combination of Measure.
+  GainAnalysis(double sampling_rate, const std::vector<uint32_t>& channel_map,
+               int measures)
+      : channels_{static_cast<int>(channel_map.size())},
         stats_{lib1770_stats_new()},
         block_{lib1770_block_new(sampling_rate, 400, 4)},
-        pre_{lib1770_pre_new_lfe(sampling_rate, channels, LIB1770_LFE)},
+        pre_{lib1770_pre_new_weights(sampling_rate, channels_,
+                                     GetWeights(channel_map).data())},
+        short_term_stats_{},
+        short_term_block_{},
+        position_{},
+        end_{UINT64_MAX},
         peak_{} {
+    if (measures & kTruePeak)
+      true_peak_ = std::make_unique<TruePeakMeter>(channels_);
+
     lib1770_block_add_stats(block_, stats_);
     lib1770_pre_add_block(pre_, block_);
+
+    // The blocks share the filters, so that the stream is filtered once.
+    if (measures & kLoudnessRange) {
+      short_term_stats_ = lib1770_stats_new();
+      short_term_block_ = lib1770_block_new(sampling_rate, 3000, 30);
+      lib1770_block_add_stats(short_term_block_, short_term_stats_);
+      lib1770_pre_add_block(pre_, short_term_block_);
+    }
   }
 
   ~GainAnalysis() {
     lib1770_pre_close(pre_);
     lib1770_block_close(block_);
     lib1770_stats_close(stats_);
-  }
 
-  void Update(double* samples) {
-    std::scoped_lock<std::shared_mutex> lock(mutex_);
+    if (short_term_block_ != nullptr) {
+      lib1770_block_close(short_term_block_);
+      lib1770_stats_close(short_term_stats_);
+    }
+  }
 
-    lib1770_pre_add_sample(pre_, samples);
+  // Feeds |frames| interleaved frames of |samples|.
+  void Update(const double* samples, size_t frames) {
+    // The blocks which are complete up to the end set are taken off the
+    // filters on the way.
+    for (size_t i = 0, count; i < frames; i += count) {
+      auto stop = GetStop();
+      count = stop - position_ < frames - i ? stop - position_ : frames - i;
+      lib1770_pre_add_samples(pre_, samples + i * channels_, count);
+      position_ += count;
+
+      if (position_ == stop)
+        Detach();
+    }
 
-    for (auto i = 0; i < channels_; ++i) {
+    for (size_t i = 0, count = frames * channels_; i < count; ++i) {
       auto sample = fabs(samples[i]);
       if (peak_ < sample)
         peak_ = sample;
     }
+
+    if (true_peak_ != nullptr)
+      true_peak_->Update(samples, frames);
   }
 
-  double Loudness() {
-    std::shared_lock<std::shared_mutex> lock(mutex_);
+  // Limits the blocks measured to those starting within the next |frames|
+  // frames, for a segment which another analysis continues. Up to overlap()
+  // frames more are needed to complete them.
+  void SetEnd(uint64_t frames) {
+    end_ = position_ + frames;
+  }
 
-    return lib1770_stats_get_mean(stats_, -10);
+  // Ends the stream. Must be called once after the last Update of a stream,
+  // but not for a segment which another analysis continues. Tail::kPad
+  // completes the 400 ms blocks only.
+  void Finalize(Tail tail) {
+    lib1770_pre_flush(pre_);
+
+    if (tail == Tail::kPad) {
+      // Completes the newest block holding any part of the stream; the blocks
+      // starting after it would hold nothing but silence.
+      auto count = block_->ring.count;
+      auto frames = block_->block_size -
+                    (count != 0 ? count : block_->overlap_size);
+      std::vector<double> silence(frames * channels_);
+      lib1770_pre_add_samples(pre_, silence.data(), frames);
+    }
   }
 
-  double Peak() {
-    std::shared_lock<std::shared_mutex> lock(mutex_);
+  // Feeds |frames| interleaved frames of |samples| through the filters only,
+  // to settle them before the part of the stream to be measured.
+  void Prime(const double* samples, size_t frames) {
+    lib1770_pre_prime(pre_, samples, frames);
+
+    if (true_peak_ != nullptr)
+      true_peak_->Prime(samples, frames);
+  }
+
+  // Merges the blocks measured by |other|, which must have been fed another
+  // part of the same stream.
+  void Merge(const GainAnalysis& other) {
+    lib1770_stats_merge(stats_, other.stats_);
+
+    if (short_term_stats_ != nullptr && other.short_term_stats_ != nullptr)
+      lib1770_stats_merge(short_term_stats_, other.short_term_stats_);
+
+    if (peak_ < other.peak_)
+      peak_ = other.peak_;
+
+    if (true_peak_ != nullptr && other.true_peak_ != nullptr)
+      true_peak_->Merge(*other.true_peak_);
+  }
 
+  double Loudness() {
+    return lib1770_stats_get_mean(stats_, -10);
+  }
+
+  double Peak() const {
     return peak_;
   }
 
+  // Returns a negative value if the true peak is not measured.
+  double TruePeak() const {
+    return true_peak_ != nullptr ? true_peak_->Peak() : -1.0;
+  }
+
+  // Maximum loudness of the 400 ms blocks.
+  double MaxMomentary() const {
+    return lib1770_stats_get_max(stats_);
+  }
+
+  // Returns a negative value if the loudness range is not measured.
+  double LoudnessRange() const {
+    if (short_term_stats_ == nullptr)
+      return -1.0;
+
+    return lib1770_stats_get_range(short_term_stats_, -20, 0.1, 0.95);
+  }
+
+  // Maximum loudness of the 3 s blocks; only valid if the loudness range is
+  // measured.
+  double MaxShortTerm() const {
+    return lib1770_stats_get_max(short_term_stats_);
+  }
+
+  // Number of frames by which the blocks starting before any frame may
+  // extend past it.
+  size_t overlap() const {
+    auto overlap = block_->block_size - block_->overlap_size;
+    if (short_term_block_ != nullptr) {
+      overlap = std::max(overlap, short_term_block_->block_size -
+                                      short_term_block_->overlap_size);
+    }
+
+    return overlap;
+  }
+
+  // Number of frames between the frames on which blocks of every length
+  // start.
+  size_t step() const {
+    if (short_term_block_ == nullptr)
+      return block_->overlap_size;
+
+    return std::lcm(block_->overlap_size, short_term_block_->overlap_size);
+  }
+
+  void GetHistogram(GainHistogram* histogram) const {
+    histogram->mean = stats_->hist.pass1.wmsq;
+    histogram->count = stats_->hist.pass1.count;
+    histogram->max = stats_->max.wmsq;
+    histogram->bins.clear();
+    for (uint32_t i = 0; i < LIB1770_HIST_NBINS; ++i) {
+      if (stats_->hist.count[i] != 0)
+        histogram->bins.emplace_back(i, stats_->hist.count[i]);
+    }
+  }
+
  private:
   friend class GainAggregator;
 
-  std::shared_mutex mutex_;
+  // Channel weights of ITU BS.1770: 1.41 for the surround channels, none for
+  // the LFE, 1.0 for the others. The surround channels are the side ones if
+  // there are any, as in 7.1, and the back ones otherwise, as in 5.1.
+  static std::vector<double> GetWeights(
+      const std::vector<uint32_t>& channel_map) {
+    auto sides = std::any_of(
+        channel_map.begin(), channel_map.end(), [](uint32_t speaker) {
+          return speaker == kSideLeft || speaker == kSideRight;
+        });
+
+    std::vector<double> weights;
+    for (auto speaker : channel_map) {
+      switch (speaker) {
+        case kLowFrequency:
+          weights.push_back(0.0);
+          break;
+
+        case kBackLeft:
+        case kBackRight:
+          weights.push_back(sides ? 1.0 : 1.41);
+          break;
+
+        case kSideLeft:
+        case kSideRight:
+          weights.push_back(1.41);
+          break;
+
+        default:
+          weights.push_back(1.0);
+          break;
+      }
+    }
+
+    return weights;
+  }
+
+  // Returns the position at which the next of the blocks attached to the
+  // filters is complete up to the end set, or UINT64_MAX.
+  uint64_t GetStop() const {
+    auto stop = UINT64_MAX;
+    if (end_ != UINT64_MAX) {
+      for (auto block = pre_->block; block != nullptr; block = block->next) {
+        stop = std::min<uint64_t>(
+            stop, end_ + block->block_size - block->overlap_size);
+      }
+    }
+
+    return stop;
+  }
+
+  // Takes the blocks which are complete up to the end set off the filters.
+  void Detach() {
+    std::vector<lib1770_block_t*> blocks;
+    for (auto block = pre_->block; block != nullptr; block = block->next) {
+      if (position_ < end_ + block->block_size - block->overlap_size)
+        blocks.push_back(block);
+    }
+
+    pre_->block = nullptr;
+    for (auto block : blocks)
+      lib1770_pre_add_block(pre_, block);
+  }
 
   const int channels_;
   lib1770_stats_t* const stats_;
   lib1770_block_t* const block_;
   lib1770_pre_t* const pre_;
+  lib1770_stats_t* short_term_stats_;
+  lib1770_block_t* short_term_block_;
+  uint64_t position_;  // number of frames measured.
+  uint64_t end_;       // position of the end set, if any.
   double peak_;
+  std::unique_ptr<TruePeakMeter> true_peak_;
 
   GainAnalysis(const GainAnalysis&) = delete;
   GainAnalysis& operator=(const GainAnalysis&) = delete;
@@ -79,7 +368,7 @@ class GainAnalysis {
 
 class GainAggregator {
  public:
-  GainAggregator() : stats_{lib1770_stats_new()}, peak_{} {}
+  GainAggregator() : stats_{lib1770_stats_new()}, peak_{}, true_peak_{-1.0} {}
 
   ~GainAggregator() {
     lib1770_stats_close(stats_);
@@ -92,6 +381,37 @@ class GainAggregator {
 
     if (peak_ < analysis->peak_)
       peak_ = analysis->peak_;
+
+    if (true_peak_ < analysis->TruePeak())
+      true_peak_ = analysis->TruePeak();
+  }
+
+  // |true_peak| is negative if it was not measured.
+  void Merge(const GainHistogram& histogram, double peak, double true_peak) {
+    std::scoped_lock<std::shared_mutex> lock(mutex_);
+
+    // As lib1770_stats_merge does, but only the non-empty bins are touched.
+    if (stats_->max.wmsq < histogram.max)
+      stats_->max.wmsq = histogram.max;
+
+    auto count = stats_->hist.pass1.count + histogram.count;
+    if (0 < count) {
+      stats_->hist.pass1.wmsq =
+          static_cast<double>(stats_->hist.pass1.count) / count *
+              stats_->hist.pass1.wmsq +
+          static_cast<double>(histogram.count) / count * histogram.mean;
+      stats_->hist.pass1.count = count;
+      for (auto& bin : histogram.bins) {
+        if (bin.first < LIB1770_HIST_NBINS)
+          stats_->hist.count[bin.first] += bin.second;
+      }
+    }
+
+    if (peak_ < peak)
+      peak_ = peak;
+
+    if (true_peak_ < true_peak)
+      true_peak_ = true_peak;
   }
 
   double Loudness() {
@@ -106,11 +426,19 @@ class GainAggregator {
     return peak_;
   }
 
+  // Returns a negative value unless the true peak of any track was measured.
+  double TruePeak() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    return true_peak_;
+  }
+
  private:
   std::shared_mutex mutex_;
 
   lib1770_stats_t* const stats_;
   double peak_;
+  double true_peak_;
 
   GainAggregator(const GainAggregator&) = delete;
   GainAggregator& operator=(const GainAggregator&) = delete;
@@ -0,0 +1,385 @@
+// Copyright (c) 2026 dacci.org
+
+#include "audio/mp4_demuxer.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace chksound::audio {
+namespace {
+
+constexpr uint32_t MakeType(const char (&name)[5]) {
+  return static_cast<uint32_t>(name[0]) << 24 |
+         static_cast<uint32_t>(name[1]) << 16 |
+         static_cast<uint32_t>(name[2]) << 8 | static_cast<uint32_t>(name[3]);
+}
+
+constexpr uint32_t kMoov = MakeType("moov");
+constexpr uint32_t kTrak = MakeType("trak");
+constexpr uint32_t kMdia = MakeType("mdia");
+constexpr uint32_t kHdlr = MakeType("hdlr");
+constexpr uint32_t kSoun = MakeType("soun");
+constexpr uint32_t kMdhd = MakeType("mdhd");
+constexpr uint32_t kMinf = MakeType("minf");
+constexpr uint32_t kStbl = MakeType("stbl");
+constexpr uint32_t kStsd = MakeType("stsd");
+constexpr uint32_t kMp4a = MakeType("mp4a");
+constexpr uint32_t kWave = MakeType("wave");
+constexpr uint32_t kEsds = MakeType("esds");
+constexpr uint32_t kStts = MakeType("stts");
+constexpr uint32_t kStsz = MakeType("stsz");
+constexpr uint32_t kStsc = MakeType("stsc");
+constexpr uint32_t kStco = MakeType("stco");
+constexpr uint32_t kCo64 = MakeType("co64");
+
+// Descriptor tags of ISO/IEC 14496-1.
+constexpr int kESDescrTag = 0x03;
+constexpr int kDecoderConfigDescrTag = 0x04;
+constexpr int kDecSpecificInfoTag = 0x05;
+
+// Object types of DecoderConfigDescriptor: MPEG-4 audio, and the three
+// profiles of MPEG-2 AAC.
+constexpr int kMpeg4Audio = 0x40;
+constexpr int kMpeg2AacMain = 0x66;
+constexpr int kMpeg2AacSsr = 0x68;
+
+uint16_t ReadU16(const unsigned char* data) {
+  return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+uint32_t ReadU32(const unsigned char* data) {
+  return static_cast<uint32_t>(data[0]) << 24 |
+         static_cast<uint32_t>(data[1]) << 16 |
+         static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+uint64_t ReadU64(const unsigned char* data) {
+  return static_cast<uint64_t>(ReadU32(data)) << 32 | ReadU32(data + 4);
+}
+
+// Box of ISO/IEC 14496-12, with the payload in [begin, end).
+struct Box {
+  uint32_t type;
+  const unsigned char* begin;
+  const unsigned char* end;
+
+  size_t size() const {
+    return end - begin;
+  }
+};
+
+// Reads the box at |*position| and advances |*position| past it. Returns
+// false at |end| or if the box does not fit before |end|.
+bool NextBox(const unsigned char** position, const unsigned char* end,
+             Box* box) {
+  auto data = *position;
+  if (end - data < 8)
+    return false;
+
+  uint64_t size = ReadU32(data);
+  size_t header = 8;
+  if (size == 1) {
+    if (end - data < 16)
+      return false;
+
+    size = ReadU64(data + 8);
+    header = 16;
+  } else if (size == 0) {
+    size = end - data;  // extends to the end of the file.
+  }
+
+  if (size < header || static_cast<uint64_t>(end - data) < size)
+    return false;
+
+  box->type = ReadU32(data + 4);
+  box->begin = data + header;
+  box->end = data + size;
+  *position = box->end;
+  return true;
+}
+
+// Finds the first box of |type| among the boxes in [begin, end).
+bool FindBox(const unsigned char* begin, const unsigned char* end,
+             uint32_t type, Box* box) {
+  for (auto position = begin; NextBox(&position, end, box);) {
+    if (box->type == type)
+      return true;
+  }
+
+  return false;
+}
+
+}  // namespace
+
+Mp4Demuxer::Mp4Demuxer() : data_{}, size_{}, duration_{}, timescale_{} {}
+
+bool Mp4Demuxer::Open(const unsigned char* data, size_t size) {
+  data_ = data;
+  size_ = size;
+
+  Box moov;
+  if (!FindBox(data, data + size, kMoov, &moov))
+    return false;
+
+  Box trak;
+  for (auto position = moov.begin; NextBox(&position, moov.end, &trak);) {
+    if (trak.type == kTrak && ParseTrack(trak.begin, trak.end))
+      return true;
+  }
+
+  return false;
+}
+
+bool Mp4Demuxer::GetSample(size_t index, const unsigned char** data,
+                           size_t* size) const {
+  if (samples_.size() <= index)
+    return false;
+
+  *data = data_ + samples_[index].offset;
+  *size = samples_[index].size;
+  return true;
+}
+
+bool Mp4Demuxer::ParseTrack(const unsigned char* begin,
+                            const unsigned char* end) {
+  Box mdia;
+  Box hdlr;
+  if (!FindBox(begin, end, kMdia, &mdia) ||
+      !FindBox(mdia.begin, mdia.end, kHdlr, &hdlr) || hdlr.size() < 12 ||
+      ReadU32(hdlr.begin + 8) != kSoun)
+    return false;
+
+  // The creation and modification times precede the timescale; all three are
+  // 64 bits wide in version 1.
+  Box mdhd;
+  if (!FindBox(mdia.begin, mdia.end, kMdhd, &mdhd) || mdhd.size() < 4)
+    return false;
+
+  size_t offset = mdhd.begin[0] == 1 ? 20 : 12;
+  if (mdhd.size() < offset + 4)
+    return false;
+
+  timescale_ = ReadU32(mdhd.begin + offset);
+
+  Box minf;
+  Box stbl;
+  if (timescale_ == 0 || !FindBox(mdia.begin, mdia.end, kMinf, &minf) ||
+      !FindBox(minf.begin, minf.end, kStbl, &stbl))
+    return false;
+
+  return ParseSampleTable(stbl.begin, stbl.end);
+}
+
+bool Mp4Demuxer::ParseSampleEntry(const unsigned char* begin,
+                                  const unsigned char* end) {
+  // AudioSampleEntry is extended by 16 or 36 bytes in version 1 or 2 of
+  // QuickTime, which also nests esds in a wave box.
+  if (end - begin < 28)
+    return false;
+
+  size_t length;
+  switch (ReadU16(begin + 8)) {
+    case 0:
+      length = 28;
+      break;
+
+    case 1:
+      length = 44;
+      break;
+
+    case 2:
+      length = 64;
+      break;
+
+    default:
+      return false;
+  }
+
+  if (static_cast<size_t>(end - begin) < length)
+    return false;
+
+  Box esds;
+  if (!FindBox(begin + length, end, kEsds, &esds)) {
+    Box wave;
+    if (!FindBox(begin + length, end, kWave, &wave) ||
+        !FindBox(wave.begin, wave.end, kEsds, &esds))
+      return false;
+  }
+
+  // esds is a full box.
+  return 4 <= esds.size() && ParseDescriptor(esds.begin + 4, esds.end);
+}
+
+bool Mp4Demuxer::ParseDescriptor(const unsigned char* begin,
+                                 const unsigned char* end) {
+  for (auto data = begin; data < end;) {
+    auto tag = *data++;
+
+    // The length is coded in 7 bits per byte, in up to 4 bytes.
+    size_t length = 0;
+    for (auto i = 0; i < 4; ++i) {
+      if (data == end)
+        return false;
+
+      auto byte = *data++;
+      length = length << 7 | (byte & 0x7F);
+      if ((byte & 0x80) == 0)
+        break;
+    }
+
+    if (static_cast<size_t>(end - data) < length)
+      return false;
+
+    auto payload = data;
+    data += length;
+
+    switch (tag) {
+      case kESDescrTag: {
+        // ES_ID, then the flags of the optional fields.
+        if (length < 3)
+          return false;
+
+        auto flags = payload[2];
+        size_t skip = 3;
+        if (flags & 0x80)  // streamDependenceFlag
+          skip += 2;
+        if (flags & 0x40) {  // URL_Flag
+          if (length <= skip)
+            return false;
+
+          skip += 1 + payload[skip];
+        }
+        if (flags & 0x20)  // OCRstreamFlag
+          skip += 2;
+
+        return skip <= length &&
+               ParseDescriptor(payload + skip, payload + length);
+      }
+
+      case kDecoderConfigDescrTag: {
+        if (length < 13)
+          return false;
+
+        auto object_type = payload[0];
+        if (object_type != kMpeg4Audio &&
+            (object_type < kMpeg2AacMain || kMpeg2AacSsr < object_type))
+          return false;
+
+        return ParseDescriptor(payload + 13, payload + length);
+      }
+
+      case kDecSpecificInfoTag:
+        config_.assign(payload, payload + length);
+        return !config_.empty();
+    }
+  }
+
+  return false;
+}
+
+bool Mp4Demuxer::ParseSampleTable(const unsigned char* begin,
+                                  const unsigned char* end) {
+  Box stsd;
+  Box entry;
+  if (!FindBox(begin, end, kStsd, &stsd) || stsd.size() < 8)
+    return false;
+
+  auto position = stsd.begin + 8;
+  if (!NextBox(&position, stsd.end, &entry))
+    return false;
+
+  // ALAC and the other codecs are not decoded; the track is skipped so that
+  // a later AAC track may be found.
+  if (entry.type != kMp4a) {
+    char name[] = {static_cast<char>(entry.type >> 24),
+                   static_cast<char>(entry.type >> 16),
+                   static_cast<char>(entry.type >> 8),
+                   static_cast<char>(entry.type), '\0'};
+    std::cerr << "skipped unsupported audio track: " << name << std::endl;
+    return false;
+  }
+
+  if (!ParseSampleEntry(entry.begin, entry.end))
+    return false;
+
+  Box stsz;
+  if (!FindBox(begin, end, kStsz, &stsz) || stsz.size() < 12)
+    return false;
+
+  auto uniform_size = ReadU32(stsz.begin + 4);
+  auto count = ReadU32(stsz.begin + 8);
+  auto sizes = stsz.begin + 12;
+  if (uniform_size == 0 && (stsz.size() - 12) / 4 < count)
+    return false;
+
+  Box stco;
+  auto wide = false;
+  if (!FindBox(begin, end, kStco, &stco)) {
+    if (!FindBox(begin, end, kCo64, &stco))
+      return false;
+
+    wide = true;
+  }
+
+  if (stco.size() < 8)
+    return false;
+
+  auto chunks = ReadU32(stco.begin + 4);
+  auto offsets = stco.begin + 8;
+  if ((stco.size() - 8) / (wide ? 8 : 4) < chunks)
+    return false;
+
+  Box stsc;
+  if (!FindBox(begin, end, kStsc, &stsc) || stsc.size() < 8)
+    return false;
+
+  auto runs = ReadU32(stsc.begin + 4);
+  auto run_data = stsc.begin + 8;
+  if (runs == 0 || (stsc.size() - 8) / 12 < runs)
+    return false;
+
+  // Each run of stsc gives the number of samples in the chunks from its first
+  // chunk, numbered from 1, to the first chunk of the next run.
+  // Samples of a uniform size are not backed by stsz, so their count is
+  // bounded by the size of the file instead.
+  samples_.clear();
+  samples_.reserve(uniform_size != 0
+                       ? std::min<size_t>(count, size_ / uniform_size)
+                       : count);
+  for (uint32_t chunk = 0, run = 0; chunk < chunks && samples_.size() < count;
+       ++chunk) {
+    while (run + 1 < runs && ReadU32(run_data + (run + 1) * 12) <= chunk + 1)
+      ++run;
+
+    auto samples = ReadU32(run_data + run * 12 + 4);
+    uint64_t offset = wide ? ReadU64(offsets + chunk * 8)
+                           : ReadU32(offsets + chunk * 4);
+    for (uint32_t i = 0; i < samples && samples_.size() < count; ++i) {
+      auto size = uniform_size != 0 ? uniform_size
+                                    : ReadU32(sizes + samples_.size() * 4);
+      if (size_ < offset || size_ - offset < size)
+        return false;
+
+      samples_.push_back({offset, size});
+      offset += size;
+    }
+  }
+
+  if (samples_.size() != count)
+    return false;
+
+  duration_ = 0;
+  Box stts;
+  if (FindBox(begin, end, kStts, &stts) && 8 <= stts.size()) {
+    auto entries = ReadU32(stts.begin + 4);
+    auto data = stts.begin + 8;
+    for (uint32_t i = 0; i < entries && (i + 1) * 8 <= stts.size() - 8; ++i) {
+      duration_ += static_cast<uint64_t>(ReadU32(data + i * 8)) *
+                   ReadU32(data + i * 8 + 4);
+    }
+  }
+
+  return true;
+}
+
+}  // namespace chksound::audio
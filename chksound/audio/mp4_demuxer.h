@@ -0,0 +1,70 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_AUDIO_MP4_DEMUXER_H_
+#define CHKSOUND_AUDIO_MP4_DEMUXER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace chksound::audio {
+
+// Locates the access units of the first AAC track of an MP4 file held in
+// memory, for a decoder which is given the raw access units. Only the boxes
+// needed for that are read: the AudioSpecificConfig from stsd, and the sample
+// table from stsz, stsc and stco or co64.
+class Mp4Demuxer {
+ public:
+  Mp4Demuxer();
+
+  // Parses the |size| bytes of the file at |data|, which must outlive the
+  // demuxer. Returns false if the file holds no AAC track.
+  bool Open(const unsigned char* data, size_t size);
+
+  // Returns the access unit |index| in |data| and |size|.
+  bool GetSample(size_t index, const unsigned char** data,
+                 size_t* size) const;
+
+  size_t GetSampleCount() const {
+    return samples_.size();
+  }
+
+  // AudioSpecificConfig of ISO/IEC 14496-3.
+  const std::vector<unsigned char>& config() const {
+    return config_;
+  }
+
+  // Length of the track in 1/timescale() seconds, summed from stts.
+  uint64_t duration() const {
+    return duration_;
+  }
+
+  uint32_t timescale() const {
+    return timescale_;
+  }
+
+ private:
+  struct Sample {
+    uint64_t offset;
+    uint32_t size;
+  };
+
+  bool ParseTrack(const unsigned char* begin, const unsigned char* end);
+  bool ParseSampleEntry(const unsigned char* begin, const unsigned char* end);
+  bool ParseDescriptor(const unsigned char* begin, const unsigned char* end);
+  bool ParseSampleTable(const unsigned char* begin, const unsigned char* end);
+
+  const unsigned char* data_;
+  size_t size_;
+  std::vector<unsigned char> config_;
+  std::vector<Sample> samples_;
+  uint64_t duration_;
+  uint32_t timescale_;
+
+  Mp4Demuxer(const Mp4Demuxer&) = delete;
+  Mp4Demuxer& operator=(const Mp4Demuxer&) = delete;
+};
+
+}  // namespace chksound::audio
+
+#endif  // CHKSOUND_AUDIO_MP4_DEMUXER_H_
@@ -0,0 +1,112 @@
+// Copyright (c) 2026 dacci.org
+
+#include "audio/true_peak.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#define CHKSOUND_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace chksound::audio {
+namespace {
+
+// Interpolator of ITU BS.1770-4 Annex 2, one row per phase.
+constexpr double kCoefficients[4][TruePeakMeter::kTaps] = {
+    {0.0017089843750, 0.0109863281250, -0.0196533203125, 0.0332031250000,
+     -0.0594482421875, 0.1373291015625, 0.9721679687500, -0.1022949218750,
+     0.0476074218750, -0.0266113281250, 0.0148925781250, -0.0083007812500},
+    {-0.0291748046875, 0.0292968750000, -0.0517578125000, 0.0891113281250,
+     -0.1665039062500, 0.4650878906250, 0.7797851562500, -0.2003173828125,
+     0.1015625000000, -0.0582275390625, 0.0330810546875, -0.0189208984375},
+    {-0.0189208984375, 0.0330810546875, -0.0582275390625, 0.1015625000000,
+     -0.2003173828125, 0.7797851562500, 0.4650878906250, -0.1665039062500,
+     0.0891113281250, -0.0517578125000, 0.0292968750000, -0.0291748046875},
+    {-0.0083007812500, 0.0148925781250, -0.0266113281250, 0.0476074218750,
+     -0.1022949218750, 0.9721679687500, 0.1373291015625, -0.0594482421875,
+     0.0332031250000, -0.0196533203125, 0.0109863281250, 0.0017089843750},
+};
+
+constexpr size_t kHistory = TruePeakMeter::kTaps - 1;
+
+}  // namespace
+
+TruePeakMeter::TruePeakMeter(int channels)
+    : channels_{channels}, history_(kHistory * channels), peak_{} {}
+
+void TruePeakMeter::Update(const double* samples, size_t frames) {
+  Load(samples, frames);
+
+  auto stride = kHistory + frames;
+  for (int i = 0; i < channels_; ++i)
+    peak_ = std::max(peak_, Filter(buffer_.data() + stride * i, frames));
+}
+
+void TruePeakMeter::Prime(const double* samples, size_t frames) {
+  Load(samples, frames);
+}
+
+void TruePeakMeter::Load(const double* samples, size_t frames) {
+  auto stride = kHistory + frames;
+  buffer_.resize(stride * channels_);
+
+  for (int i = 0; i < channels_; ++i) {
+    auto channel = buffer_.data() + stride * i;
+    auto history = history_.data() + kHistory * i;
+    std::copy_n(history, kHistory, channel);
+    for (size_t j = 0; j < frames; ++j)
+      channel[kHistory + j] = samples[j * channels_ + i];
+
+    std::copy_n(channel + frames, kHistory, history);
+  }
+}
+
+double TruePeakMeter::Filter(const double* input, size_t frames) {
+  size_t i = 0;
+  double peak = 0.0;
+
+#ifdef CHKSOUND_SSE2
+  // Four consecutive samples at a time, two per register.
+  auto mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFF));
+  auto max = _mm_setzero_pd();
+  for (; i + 4 <= frames; i += 4) {
+    __m128d lo[4] = {};
+    __m128d hi[4] = {};
+    for (size_t j = 0; j < kTaps; ++j) {
+      auto x = input + i + kHistory - j;
+      auto x0 = _mm_loadu_pd(x);
+      auto x1 = _mm_loadu_pd(x + 2);
+      for (size_t k = 0; k < 4; ++k) {
+        auto c = _mm_set1_pd(kCoefficients[k][j]);
+        lo[k] = _mm_add_pd(lo[k], _mm_mul_pd(c, x0));
+        hi[k] = _mm_add_pd(hi[k], _mm_mul_pd(c, x1));
+      }
+    }
+
+    for (size_t k = 0; k < 4; ++k) {
+      max = _mm_max_pd(max, _mm_and_pd(lo[k], mask));
+      max = _mm_max_pd(max, _mm_and_pd(hi[k], mask));
+    }
+  }
+
+  max = _mm_max_pd(max, _mm_unpackhi_pd(max, max));
+  peak = _mm_cvtsd_f64(max);
+#endif
+
+  for (; i < frames; ++i) {
+    for (auto& phase : kCoefficients) {
+      double sum = 0.0;
+      for (size_t j = 0; j < kTaps; ++j)
+        sum += phase[j] * input[i + kHistory - j];
+
+      peak = std::max(peak, std::fabs(sum));
+    }
+  }
+
+  return peak;
+}
+
+}  // namespace chksound::audio
@@ -0,0 +1,61 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_AUDIO_TRUE_PEAK_H_
+#define CHKSOUND_AUDIO_TRUE_PEAK_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace chksound::audio {
+
+// Measures the true peak of a stream as ITU BS.1770-4 Annex 2 does: the
+// stream is oversampled 4 times by the polyphase FIR of the recommendation
+// and the largest absolute value of the result is taken. Like GainAnalysis,
+// an instance is fed by a single thread.
+class TruePeakMeter {
+ public:
+  // Number of taps of each phase of the interpolator.
+  static constexpr size_t kTaps = 12;
+
+  explicit TruePeakMeter(int channels);
+
+  // Feeds |frames| interleaved frames of |samples|.
+  void Update(const double* samples, size_t frames);
+
+  // Feeds |frames| interleaved frames of |samples| into the history of the
+  // interpolator only, without measuring them.
+  void Prime(const double* samples, size_t frames);
+
+  // Takes the peak measured by |other|, which must have been fed another part
+  // of the same stream.
+  void Merge(const TruePeakMeter& other) {
+    if (peak_ < other.peak_)
+      peak_ = other.peak_;
+  }
+
+  double Peak() const {
+    return peak_;
+  }
+
+ private:
+  // Copies |frames| frames of |samples| to |buffer_| channel by channel, each
+  // after the kTaps - 1 frames preceding them.
+  void Load(const double* samples, size_t frames);
+
+  // Returns the largest absolute value of the 4 phases interpolated for each
+  // of the |frames| samples following kTaps - 1 samples of history at
+  // |input|.
+  static double Filter(const double* input, size_t frames);
+
+  const int channels_;
+  std::vector<double> history_;  // kTaps - 1 frames per channel.
+  std::vector<double> buffer_;
+  double peak_;
+
+  TruePeakMeter(const TruePeakMeter&) = delete;
+  TruePeakMeter& operator=(const TruePeakMeter&) = delete;
+};
+
+}  // namespace chksound::audio
+
+#endif  // CHKSOUND_AUDIO_TRUE_PEAK_H_
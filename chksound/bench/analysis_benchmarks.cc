@@ -0,0 +1,87 @@
+// Copyright (c) 2026 dacci.org
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "audio/true_peak.h"
+#include "bench/corpus.h"
+#include "bench/suites.h"
+#include "util/thread_pool.h"
+
+namespace chksound::bench {
+namespace {
+
+using audio::GainAnalysis;
+using audio::TruePeakMeter;
+
+// Times each set of measures, and prints what each costs over the loudness
+// alone for every second decoded.
+void BenchmarkMeasures(Harness* harness, const Signal& signal) {
+  struct Measures {
+    const char* name;
+    int measures;
+  };
+
+  const Measures cases[] = {
+      {"loudness", 0},
+      {"true peak", GainAnalysis::kTruePeak},
+      {"loudness range", GainAnalysis::kLoudnessRange},
+      {"all", GainAnalysis::kTruePeak | GainAnalysis::kLoudnessRange},
+  };
+
+  double loudness = 0.0;
+  for (auto& test : cases) {
+    auto name = std::string("GainAnalysis ") + test.name;
+    auto time = harness->Measure(
+        name, [&signal, &test]() { Analyze(signal, test.measures); },
+        signal.seconds(), "x realtime");
+    if (test.measures == 0)
+      loudness = time;
+    else
+      harness->Print(name + " overhead",
+                     (time - loudness) / signal.seconds() * 1e3,
+                     "ms per second");
+  }
+}
+
+// Times the true peak meter on its own, fed as GainAnalysis feeds it.
+void BenchmarkTruePeak(Harness* harness, const Signal& signal) {
+  harness->Measure(
+      "TruePeakMeter",
+      [&signal]() {
+        TruePeakMeter meter(signal.channels);
+        for (size_t i = 0; i < signal.frames(); i += 4096) {
+          meter.Update(signal.samples.data() + i * signal.channels,
+                       std::min<size_t>(4096, signal.frames() - i));
+        }
+      },
+      signal.seconds(), "x realtime");
+}
+
+// Measures as many copies of |signal| at a time as there are threads, as the
+// application does with tracks.
+void BenchmarkThreads(Harness* harness, const Signal& signal, size_t threads) {
+  util::ThreadPool pool(threads);
+  auto tracks = pool.size() * 4;
+
+  harness->Measure(
+      "GainAnalysis on " + std::to_string(pool.size()) + " threads",
+      [&signal, &pool, tracks]() {
+        for (size_t i = 0; i < tracks; ++i)
+          pool.Post([&signal]() { Analyze(signal, 0); });
+        pool.Wait();
+      },
+      signal.seconds() * tracks, "x realtime");
+}
+
+}  // namespace
+
+void BenchmarkAnalysis(Harness* harness, size_t threads) {
+  auto signal = PinkNoise(44100.0, 2, 60.0, -20.0);
+  BenchmarkMeasures(harness, signal);
+  BenchmarkTruePeak(harness, signal);
+  BenchmarkThreads(harness, signal, threads);
+}
+
+}  // namespace chksound::bench
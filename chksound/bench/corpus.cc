@@ -0,0 +1,143 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/corpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace chksound::bench {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr size_t kFramesPerRead = 4096;
+
+}  // namespace
+
+Signal Sine(double sampling_rate, int channels, double seconds,
+            double frequency, double level, double phase) {
+  Signal signal{sampling_rate, channels};
+  auto frames = static_cast<size_t>(std::llround(seconds * sampling_rate));
+  auto amplitude = std::pow(10.0, level / 20.0);
+  auto step = 2.0 * kPi * frequency / sampling_rate;
+  signal.samples.resize(frames * channels);
+  for (size_t i = 0; i < frames; ++i) {
+    auto sample = amplitude * std::sin(step * i + phase);
+    for (int j = 0; j < channels; ++j)
+      signal.samples[i * channels + j] = sample;
+  }
+
+  return signal;
+}
+
+Signal PinkNoise(double sampling_rate, int channels, double seconds,
+                 double level, uint32_t seed) {
+  Signal signal{sampling_rate, channels};
+  auto frames = static_cast<size_t>(std::llround(seconds * sampling_rate));
+  signal.samples.resize(frames * channels);
+
+  std::mt19937 engine(seed);
+  std::normal_distribution<double> white;
+  for (int j = 0; j < channels; ++j) {
+    // Paul Kellet's filter, which is within 0.05 dB of -3 dB per octave
+    // above 9.2 Hz at 44.1 kHz.
+    double b[7] = {};
+    double sum = 0.0;
+    for (size_t i = 0; i < frames; ++i) {
+      auto x = white(engine);
+      b[0] = 0.99886 * b[0] + x * 0.0555179;
+      b[1] = 0.99332 * b[1] + x * 0.0750759;
+      b[2] = 0.96900 * b[2] + x * 0.1538520;
+      b[3] = 0.86650 * b[3] + x * 0.3104856;
+      b[4] = 0.55000 * b[4] + x * 0.5329522;
+      b[5] = -0.7616 * b[5] - x * 0.0168980;
+      auto y = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + x * 0.5362;
+      b[6] = x * 0.115926;
+
+      signal.samples[i * channels + j] = y;
+      sum += y * y;
+    }
+
+    // Scaled to the exact level asked for.
+    auto gain = std::pow(10.0, level / 20.0) / std::sqrt(sum / frames);
+    for (size_t i = 0; i < frames; ++i)
+      signal.samples[i * channels + j] *= gain;
+  }
+
+  return signal;
+}
+
+void Append(Signal* signal, const Signal& part) {
+  signal->samples.insert(signal->samples.end(), part.samples.begin(),
+                         part.samples.end());
+}
+
+void Scale(Signal* signal, int channel, double gain) {
+  for (size_t i = channel; i < signal->samples.size(); i += signal->channels)
+    signal->samples[i] *= gain;
+}
+
+SignalReader::SignalReader(const Signal* signal)
+    : signal_{signal}, position_{} {}
+
+size_t SignalReader::Read(double* buffer, size_t frames) {
+  auto count = std::min<uint64_t>(frames, signal_->frames() - position_);
+  auto begin = signal_->samples.begin() + position_ * signal_->channels;
+  std::copy(begin, begin + count * signal_->channels, buffer);
+  position_ += count;
+
+  return count;
+}
+
+uint64_t SignalReader::GetLength(uint64_t exact_from) {
+  return signal_->frames();
+}
+
+bool SignalReader::Seek(uint64_t frame) {
+  if (signal_->frames() < frame)
+    return false;
+
+  position_ = frame;
+  return true;
+}
+
+double SignalReader::GetSamplingRate() const {
+  return signal_->sampling_rate;
+}
+
+int SignalReader::GetChannels() const {
+  return signal_->channels;
+}
+
+std::vector<uint32_t> SignalReader::GetChannelMap() const {
+  if (signal_->channel_map.empty())
+    return AudioReader::GetChannelMap();
+
+  return signal_->channel_map;
+}
+
+Measurement Analyze(const Signal& signal, int measures,
+                    audio::GainAnalysis::Tail tail) {
+  SignalReader reader(&signal);
+  audio::GainAnalysis analysis(reader.GetSamplingRate(),
+                               reader.GetChannelMap(), measures);
+
+  std::vector<double> buffer(kFramesPerRead * reader.GetChannels());
+  while (auto count = reader.Read(buffer.data(), kFramesPerRead))
+    analysis.Update(buffer.data(), count);
+  analysis.Finalize(tail);
+
+  Measurement measurement;
+  measurement.loudness = analysis.Loudness();
+  measurement.peak = analysis.Peak();
+  measurement.true_peak = analysis.TruePeak();
+  measurement.loudness_range = analysis.LoudnessRange();
+  measurement.max_momentary = analysis.MaxMomentary();
+  measurement.max_short_term = 0.0 <= measurement.loudness_range
+                                   ? analysis.MaxShortTerm()
+                                   : -HUGE_VAL;
+
+  return measurement;
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,85 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_CORPUS_H_
+#define CHKSOUND_BENCH_CORPUS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "audio/audio_reader.h"
+#include "audio/gain_analysis.h"
+
+namespace chksound::bench {
+
+// Interleaved PCM generated in memory, full scale being 1.0.
+struct Signal {
+  double sampling_rate;
+  int channels;
+  std::vector<uint32_t> channel_map;  // the usual layout if empty.
+  std::vector<double> samples;
+
+  size_t frames() const {
+    return samples.size() / channels;
+  }
+
+  double seconds() const {
+    return frames() / sampling_rate;
+  }
+};
+
+// Sine of |frequency| Hz whose peak is at |level| dBFS, the same in every
+// channel, starting at |phase| radians.
+Signal Sine(double sampling_rate, int channels, double seconds,
+            double frequency, double level, double phase = 0.0);
+
+// Pink noise whose RMS is at |level| dBFS, independent in each channel.
+Signal PinkNoise(double sampling_rate, int channels, double seconds,
+                 double level, uint32_t seed = 1);
+
+// Appends the samples of |part|, which must have as many channels as
+// |signal|.
+void Append(Signal* signal, const Signal& part);
+
+// Multiplies the channel |channel| of |signal| by |gain|.
+void Scale(Signal* signal, int channel, double gain);
+
+// Reads a Signal as a decoder would.
+class SignalReader : public audio::AudioReader {
+ public:
+  explicit SignalReader(const Signal* signal);
+
+  size_t Read(double* buffer, size_t frames) override;
+  uint64_t GetLength(uint64_t exact_from) override;
+  bool Seek(uint64_t frame) override;
+  double GetSamplingRate() const override;
+  int GetChannels() const override;
+  std::vector<uint32_t> GetChannelMap() const override;
+
+ private:
+  const Signal* const signal_;
+  uint64_t position_;
+
+  SignalReader(const SignalReader&) = delete;
+  SignalReader& operator=(const SignalReader&) = delete;
+};
+
+struct Measurement {
+  double loudness;
+  double peak;
+  double true_peak;
+  double loudness_range;
+  double max_momentary;
+  double max_short_term;  // -HUGE_VAL unless the loudness range is measured.
+};
+
+// Measures |signal| with GainAnalysis as the application does, feeding it
+// through a SignalReader in reads of 4096 frames. |measures| is a
+// combination of GainAnalysis::Measure.
+Measurement Analyze(const Signal& signal, int measures,
+                    audio::GainAnalysis::Tail tail =
+                        audio::GainAnalysis::Tail::kDrop);
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_CORPUS_H_
@@ -0,0 +1,82 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/harness.h"
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+namespace chksound::bench {
+namespace {
+
+constexpr std::chrono::milliseconds kMinTime{500};
+
+}  // namespace
+
+Harness::Harness() : checks_{}, failures_{} {}
+
+void Harness::Expect(const std::string& name, bool condition) {
+  ++checks_;
+  if (!condition)
+    ++failures_;
+
+  std::cout << (condition ? "PASS " : "FAIL ") << name << std::endl;
+}
+
+void Harness::ExpectNear(const std::string& name, double actual,
+                         double expected, double tolerance) {
+  ++checks_;
+  auto passed =
+      expected - tolerance <= actual && actual <= expected + tolerance;
+  if (!passed)
+    ++failures_;
+
+  std::cout << (passed ? "PASS " : "FAIL ") << name << ": "
+            << std::defaultfloat << std::setprecision(8) << actual << " ("
+            << expected << " +/- " << tolerance << ")" << std::endl;
+}
+
+void Harness::ExpectRange(const std::string& name, double actual,
+                          double lower, double upper) {
+  ++checks_;
+  auto passed = lower <= actual && actual <= upper;
+  if (!passed)
+    ++failures_;
+
+  std::cout << (passed ? "PASS " : "FAIL ") << name << ": "
+            << std::defaultfloat << std::setprecision(8) << actual << " ("
+            << lower << " to " << upper << ")" << std::endl;
+}
+
+double Harness::Measure(const std::string& name,
+                        const std::function<void()>& body, double units,
+                        const char* unit) {
+  // The first run warms up the caches and is not counted.
+  body();
+
+  uint64_t runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{};
+  do {
+    body();
+    ++runs;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < kMinTime);
+
+  auto time = elapsed.count() / runs;
+  std::cout << "TIME " << name << ": " << std::fixed << std::setprecision(3)
+            << time * 1e3 << " ms";
+  if (0.0 < units)
+    std::cout << ", " << std::setprecision(1) << units / time << " " << unit;
+  std::cout << std::endl;
+
+  return time;
+}
+
+void Harness::Print(const std::string& name, double value, const char* unit) {
+  std::cout << "STAT " << name << ": " << std::defaultfloat
+            << std::setprecision(8) << value << " " << unit << std::endl;
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,56 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_HARNESS_H_
+#define CHKSOUND_BENCH_HARNESS_H_
+
+#include <functional>
+#include <string>
+
+namespace chksound::bench {
+
+// Runs the checks and the benchmarks of chksound_bench and reports them on
+// the standard output. A check compares a measured value against a reference
+// value; a benchmark times a piece of code.
+class Harness {
+ public:
+  Harness();
+
+  // Records a failure unless |condition| holds.
+  void Expect(const std::string& name, bool condition);
+
+  // Records a failure unless |actual| is within |tolerance| of |expected|.
+  void ExpectNear(const std::string& name, double actual, double expected,
+                  double tolerance);
+
+  // Records a failure unless |actual| is within [|lower|, |upper|].
+  void ExpectRange(const std::string& name, double actual, double lower,
+                   double upper);
+
+  // Runs |body| repeatedly for about half a second and prints the time per
+  // run, and the rate of |units| processed per run unless it is 0. Returns
+  // the time per run in seconds.
+  double Measure(const std::string& name, const std::function<void()>& body,
+                 double units = 0.0, const char* unit = nullptr);
+
+  // Prints a value measured otherwise than by time.
+  void Print(const std::string& name, double value, const char* unit);
+
+  int checks() const {
+    return checks_;
+  }
+
+  int failures() const {
+    return failures_;
+  }
+
+ private:
+  int checks_;
+  int failures_;
+
+  Harness(const Harness&) = delete;
+  Harness& operator=(const Harness&) = delete;
+};
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_HARNESS_H_
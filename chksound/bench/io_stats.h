@@ -0,0 +1,16 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_IO_STATS_H_
+#define CHKSOUND_BENCH_IO_STATS_H_
+
+#include <cstdint>
+
+namespace chksound::bench {
+
+// Returns the number of read operations the process has issued so far in
+// |count|, or false if the system does not tell.
+bool GetReadOperations(uint64_t* count);
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_IO_STATS_H_
@@ -0,0 +1,23 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/io_stats.h"
+
+#include <fstream>
+#include <string>
+
+namespace chksound::bench {
+
+bool GetReadOperations(uint64_t* count) {
+  // The syscr line counts the read(2) and pread(2) calls of all threads.
+  std::ifstream stream("/proc/self/io");
+  for (std::string name; stream >> name;) {
+    if (name == "syscr:")
+      return static_cast<bool>(stream >> *count);
+
+    stream.ignore(256, '\n');
+  }
+
+  return false;
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,12 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/io_stats.h"
+
+namespace chksound::bench {
+
+bool GetReadOperations(uint64_t* count) {
+  // Not supported.
+  return false;
+}
+
+}  // namespace chksound::bench
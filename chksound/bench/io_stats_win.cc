@@ -0,0 +1,18 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/io_stats.h"
+
+#include <windows.h>
+
+namespace chksound::bench {
+
+bool GetReadOperations(uint64_t* count) {
+  IO_COUNTERS counters;
+  if (!GetProcessIoCounters(GetCurrentProcess(), &counters))
+    return false;
+
+  *count = counters.ReadOperationCount;
+  return true;
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,69 @@
+// Copyright (c) 2026 dacci.org
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench/corpus.h"
+#include "bench/pipeline.h"
+#include "bench/reference.h"
+#include "bench/suites.h"
+
+namespace chksound::bench {
+namespace {
+
+void BenchmarkFilters(Harness* harness) {
+  for (auto channels : {1, 2, 6, 8}) {
+    auto signal = PinkNoise(48000.0, channels, 10.0, -20.0);
+    auto name = std::to_string(channels) + " ch";
+
+    harness->Measure(
+        "lib1770_pre_add_sample " + name,
+        [&signal]() { Pipeline(signal).AddSample(signal); }, signal.seconds(),
+        "x realtime");
+    harness->Measure(
+        "lib1770_pre_add_samples " + name,
+        [&signal]() { Pipeline(signal).AddSamples(signal, 4096); },
+        signal.seconds(), "x realtime");
+  }
+}
+
+void BenchmarkStats(Harness* harness) {
+  // An hour of 400 ms blocks overlapping by 75%, spread over 40 dB.
+  std::mt19937 engine(1);
+  std::uniform_real_distribution<double> level(-50.0, -10.0);
+  std::vector<double> powers(3600 * 10);
+  for (auto& power : powers)
+    power = LIB1770_DB2Q(level(engine));
+
+  auto stats = lib1770_stats_new();
+  harness->Measure(
+      "lib1770_stats_add_sqs by bsearch",
+      [stats, &powers]() {
+        for (auto power : powers)
+          ReferenceAddSqs(stats, power);
+      },
+      static_cast<double>(powers.size()), "blocks/s");
+  harness->Measure(
+      "lib1770_stats_add_sqs",
+      [stats, &powers]() {
+        for (auto power : powers)
+          lib1770_stats_add_sqs(stats, power);
+      },
+      static_cast<double>(powers.size()), "blocks/s");
+  harness->Measure("lib1770_stats_get_mean",
+                   [stats]() { lib1770_stats_get_mean(stats, -10); });
+  harness->Measure("lib1770_stats_get_range", [stats]() {
+    lib1770_stats_get_range(stats, -20, 0.1, 0.95);
+  });
+  lib1770_stats_close(stats);
+}
+
+}  // namespace
+
+void BenchmarkLib1770(Harness* harness) {
+  BenchmarkFilters(harness);
+  BenchmarkStats(harness);
+}
+
+}  // namespace chksound::bench
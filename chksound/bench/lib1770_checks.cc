@@ -0,0 +1,122 @@
+// Copyright (c) 2026 dacci.org
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "bench/corpus.h"
+#include "bench/pipeline.h"
+#include "bench/reference.h"
+#include "bench/suites.h"
+
+namespace chksound::bench {
+namespace {
+
+// Tolerances of lib1770_pre_add_samples against lib1770_pre_add_sample, as
+// documented in lib1770_pre.c.
+constexpr double kPowerTolerance = 1e-12;
+constexpr double kLoudnessTolerance = 1e-6;
+
+// Weights of the usual layouts, the LFE being the fourth channel.
+std::vector<double> GetWeights(int channels) {
+  std::vector<double> weights(channels, 1.0);
+  if (6 <= channels) {
+    weights[3] = 0.0;
+    for (auto i = 4; i < channels; ++i)
+      weights[i] = 1.41;
+  }
+
+  return weights;
+}
+
+double GetRelativeError(double actual, double expected) {
+  if (expected == 0.0)
+    return std::fabs(actual);
+
+  return std::fabs(actual - expected) / std::fabs(expected);
+}
+
+// Feeds the same signal a frame at a time and in runs of varying length,
+// which must not differ by more than the tolerances.
+void CheckBlockProcessing(Harness* harness) {
+  for (auto channels : {1, 2, 6, 8}) {
+    // The silence at the end lets the filters decay into denormals.
+    auto signal = PinkNoise(48000.0, channels, 10.0, -20.0);
+    Append(&signal, Sine(48000.0, channels, 2.0, 1000.0, -HUGE_VAL));
+    auto weights = GetWeights(channels);
+    auto name = "lib1770_pre_add_samples " + std::to_string(channels) + " ch";
+
+    Pipeline reference(signal, weights);
+    reference.AddSample(signal);
+
+    for (size_t frames : {1, 7, 4096}) {
+      Pipeline pipeline(signal, weights);
+      pipeline.AddSamples(signal, frames);
+
+      auto expected = reference.stats();
+      auto actual = pipeline.stats();
+      auto suffix = " by " + std::to_string(frames);
+      harness->Expect(name + " blocks" + suffix,
+                      actual->hist.pass1.count == expected->hist.pass1.count);
+      harness->ExpectNear(name + " mean power" + suffix,
+                          GetRelativeError(actual->hist.pass1.wmsq,
+                                           expected->hist.pass1.wmsq),
+                          0.0, kPowerTolerance);
+      harness->ExpectNear(
+          name + " max power" + suffix,
+          GetRelativeError(actual->max.wmsq, expected->max.wmsq), 0.0,
+          kPowerTolerance);
+      harness->ExpectNear(name + " loudness" + suffix,
+                          lib1770_stats_get_mean(actual, -10),
+                          lib1770_stats_get_mean(expected, -10),
+                          kLoudnessTolerance);
+    }
+  }
+}
+
+// Feeds every bin edge, the powers on either side of it and the middle of
+// every bin to lib1770_stats_add_sqs and to the bsearch() it replaced, which
+// must count them in the same bins.
+void CheckHistogram(Harness* harness) {
+  auto expected = lib1770_stats_new();
+  auto actual = lib1770_stats_new();
+  auto bins = actual->bin;
+
+  std::vector<double> powers = {0.0, bins[0].x / 2.0,
+                                bins[LIB1770_HIST_NBINS - 1].x * 2.0};
+  for (auto i = 0; i < LIB1770_HIST_NBINS; ++i) {
+    auto edge = bins[i].x;
+    powers.push_back(edge);
+    powers.push_back(std::nextafter(edge, 0.0));
+    powers.push_back(std::nextafter(edge, HUGE_VAL));
+    if (i + 1 < LIB1770_HIST_NBINS)
+      powers.push_back((edge + bins[i].y) / 2.0);
+  }
+
+  for (auto power : powers) {
+    ReferenceAddSqs(expected, power);
+    lib1770_stats_add_sqs(actual, power);
+  }
+
+  auto mismatches = 0;
+  for (auto i = 0; i < LIB1770_HIST_NBINS; ++i) {
+    if (actual->hist.count[i] != expected->hist.count[i])
+      ++mismatches;
+  }
+
+  harness->Expect("lib1770_stats_add_sqs blocks",
+                  actual->hist.pass1.count == expected->hist.pass1.count);
+  harness->ExpectNear("lib1770_stats_add_sqs bins", mismatches, 0.0, 0.0);
+
+  lib1770_stats_close(actual);
+  lib1770_stats_close(expected);
+}
+
+}  // namespace
+
+void CheckLib1770(Harness* harness) {
+  CheckBlockProcessing(harness);
+  CheckHistogram(harness);
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,184 @@
+// Copyright (c) 2026 dacci.org
+
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench/corpus.h"
+#include "bench/suites.h"
+
+namespace chksound::bench {
+namespace {
+
+using audio::GainAnalysis;
+
+// Tolerance of the integrated loudness in EBU Tech 3341.
+constexpr double kLoudnessTolerance = 0.1;
+
+// Stereo 1 kHz sine whose level changes as |parts| tell, each being a level
+// in dBFS and a duration in seconds.
+Signal Tones(double sampling_rate,
+             const std::vector<std::pair<double, double>>& parts) {
+  Signal signal{sampling_rate, 2};
+  for (auto& part : parts)
+    Append(&signal, Sine(sampling_rate, 2, part.second, 1000.0, part.first));
+
+  return signal;
+}
+
+// |mono| in the channel |channel| of |channels| channels, the others being
+// silent.
+Signal Place(const Signal& mono, int channels, int channel) {
+  Signal signal{mono.sampling_rate, channels};
+  signal.samples.resize(mono.frames() * channels);
+  for (size_t i = 0; i < mono.frames(); ++i)
+    signal.samples[i * channels + channel] = mono.samples[i];
+
+  return signal;
+}
+
+void CheckTechnicalCases(Harness* harness) {
+  struct Case {
+    const char* name;
+    std::vector<std::pair<double, double>> parts;
+    double loudness;
+  };
+
+  // Test cases 1 to 5 of EBU Tech 3341, table 1.
+  const Case cases[] = {
+      {"case 1", {{-23.0, 20.0}}, -23.0},
+      {"case 2", {{-33.0, 20.0}}, -33.0},
+      {"case 3", {{-36.0, 10.0}, {-23.0, 60.0}, {-36.0, 10.0}}, -23.0},
+      {"case 4",
+       {{-72.0, 10.0},
+        {-36.0, 10.0},
+        {-23.0, 60.0},
+        {-36.0, 10.0},
+        {-72.0, 10.0}},
+       -23.0},
+      {"case 5", {{-26.0, 20.0}, {-20.0, 20.1}, {-26.0, 20.0}}, -23.0},
+  };
+
+  for (auto sampling_rate : {48000.0, 44100.0}) {
+    auto suffix = " at " + std::to_string(static_cast<int>(sampling_rate));
+    for (auto& test : cases) {
+      auto measurement = Analyze(Tones(sampling_rate, test.parts), 0);
+      harness->ExpectNear(std::string("EBU 3341 ") + test.name + suffix,
+                          measurement.loudness, test.loudness,
+                          kLoudnessTolerance);
+    }
+  }
+
+  // The sample peak of a 1 kHz sine at 48 kHz falls on a sample.
+  auto measurement = Analyze(Tones(48000.0, {{-23.0, 1.0}}), 0);
+  harness->ExpectNear("sample peak", 20.0 * std::log10(measurement.peak),
+                      -23.0, 1e-6);
+}
+
+void CheckNoise(Harness* harness) {
+  // The K-weighting adds about 0.3 dB to pink noise, and the second channel
+  // 3 dB.
+  auto noise = PinkNoise(48000.0, 2, 20.0, -20.0);
+  auto loudness = Analyze(noise, 0).loudness;
+  harness->ExpectNear("pink noise", loudness, -17.4, 0.3);
+
+  // The loudness follows the gain exactly, the gates included.
+  auto quiet = noise;
+  Scale(&quiet, 0, std::pow(10.0, -10.0 / 20.0));
+  Scale(&quiet, 1, std::pow(10.0, -10.0 / 20.0));
+  harness->ExpectNear("pink noise 10 dB down", Analyze(quiet, 0).loudness,
+                      loudness - 10.0, 0.01);
+
+  // A signal in a surround channel weighs 1.41 times as much as in a front
+  // one, and the LFE is not measured. The surround channels are the back ones
+  // in 5.1 and the side ones in 7.1, whose back channels weigh 1.0.
+  auto mono = PinkNoise(48000.0, 1, 10.0, -20.0);
+  auto front = Analyze(Place(mono, 6, 0), 0).loudness;
+  auto surround = 10.0 * std::log10(1.41);
+  harness->ExpectNear("5.1 back weight",
+                      Analyze(Place(mono, 6, 4), 0).loudness - front,
+                      surround, 0.01);
+  harness->ExpectNear("7.1 back weight",
+                      Analyze(Place(mono, 8, 4), 0).loudness - front, 0.0,
+                      0.01);
+  harness->ExpectNear("7.1 side weight",
+                      Analyze(Place(mono, 8, 6), 0).loudness - front,
+                      surround, 0.01);
+  harness->Expect("LFE excluded",
+                  Analyze(Place(mono, 6, 3), 0).loudness <= -70.0);
+}
+
+// Checks how the 400 ms blocks which the stream ends in the middle of are
+// treated. Completed with silence, the last three blocks of a stream ending
+// on a 100 ms step hold 75%, 50% and 25% of the stream's power.
+void CheckTail(Harness* harness) {
+  // Too short for a single block.
+  auto short_tone = Tones(48000.0, {{-20.0, 0.3}});
+  harness->ExpectNear("300 ms drop",
+                      Analyze(short_tone, 0, GainAnalysis::Tail::kDrop)
+                          .loudness,
+                      LIB1770_SILENCE, 0.0);
+  harness->ExpectNear("300 ms pad",
+                      Analyze(short_tone, 0, GainAnalysis::Tail::kPad)
+                          .loudness,
+                      -20.0 + 10.0 * std::log10(1.5 / 3), 0.01);
+
+  // 197 complete blocks, and 3 more when padded.
+  auto tone = Tones(48000.0, {{-20.0, 20.0}});
+  harness->ExpectNear("20 s drop",
+                      Analyze(tone, 0, GainAnalysis::Tail::kDrop).loudness,
+                      -20.0, 0.01);
+  harness->ExpectNear("20 s pad",
+                      Analyze(tone, 0, GainAnalysis::Tail::kPad).loudness,
+                      -20.0 + 10.0 * std::log10((197 + 1.5) / 200), 0.01);
+}
+
+void CheckLoudnessRange(Harness* harness) {
+  struct Case {
+    const char* name;
+    std::vector<std::pair<double, double>> parts;
+    double loudness_range;
+  };
+
+  // Test cases 1 to 4 of EBU Tech 3342, table 1, within its tolerance.
+  const Case cases[] = {
+      {"case 1", {{-20.0, 20.0}, {-30.0, 20.0}}, 10.0},
+      {"case 2", {{-20.0, 20.0}, {-15.0, 20.0}}, 5.0},
+      {"case 3", {{-40.0, 20.0}, {-20.0, 20.0}}, 20.0},
+      {"case 4",
+       {{-50.0, 20.0},
+        {-35.0, 20.0},
+        {-20.0, 20.0},
+        {-35.0, 20.0},
+        {-50.0, 20.0}},
+       15.0},
+  };
+
+  for (auto& test : cases) {
+    auto measurement =
+        Analyze(Tones(48000.0, test.parts), GainAnalysis::kLoudnessRange);
+    harness->ExpectNear(std::string("EBU 3342 ") + test.name,
+                        measurement.loudness_range, test.loudness_range, 1.0);
+  }
+
+  // A 3 s burst starting between two whole seconds is covered by a 3 s block
+  // to within 50 ms.
+  auto burst =
+      Tones(48000.0, {{-HUGE_VAL, 0.35}, {-23.0, 3.0}, {-HUGE_VAL, 2.0}});
+  harness->ExpectNear(
+      "max short-term",
+      Analyze(burst, GainAnalysis::kLoudnessRange).max_short_term, -23.0,
+      kLoudnessTolerance);
+}
+
+}  // namespace
+
+void CheckLoudness(Harness* harness) {
+  CheckTechnicalCases(harness);
+  CheckNoise(harness);
+  CheckTail(harness);
+  CheckLoudnessRange(harness);
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,78 @@
+// Copyright (c) 2026 dacci.org
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "bench/harness.h"
+#include "bench/suites.h"
+
+namespace fs = ::std::filesystem;
+
+namespace {
+
+bool ParseSize(const fs::path& text, size_t* value) {
+  auto string = text.u8string();
+  char* end;
+  auto number = strtoull(string.c_str(), &end, 10);
+  if (string.empty() || *end != '\0')
+    return false;
+
+  *value = static_cast<size_t>(number);
+  return true;
+}
+
+}  // namespace
+
+// Runs the checks, then the benchmarks of the synthetic signals if --bench is
+// given, then those of the files given if any. Exits with 1 if any check
+// fails.
+#ifdef _UNICODE
+int wmain(int argc, const wchar_t* const* argv) {
+#else
+int main(int argc, const char* const* argv) {
+#endif
+  std::vector<fs::path> paths;
+  auto bench = false;
+  size_t jobs = 0;
+
+  for (auto i = 1; i < argc; ++i) {
+    fs::path arg(argv[i]);
+    auto name = arg.u8string();
+    if (name.compare(0, 2, "--") != 0) {
+      paths.push_back(arg);
+      continue;
+    }
+
+    auto value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (name == "--bench") {
+      bench = true;
+    } else if (name == "--jobs" && value != nullptr &&
+               ParseSize(value, &jobs)) {
+      ++i;
+    } else {
+      std::cerr << "invalid option: " << name << std::endl;
+      return 1;
+    }
+  }
+
+  chksound::bench::Harness harness;
+  chksound::bench::CheckLoudness(&harness);
+  chksound::bench::CheckTruePeak(&harness);
+  chksound::bench::CheckReaders(&harness);
+  chksound::bench::CheckLib1770(&harness);
+
+  if (bench) {
+    chksound::bench::BenchmarkLib1770(&harness);
+    chksound::bench::BenchmarkAnalysis(&harness, jobs);
+  }
+
+  if (!paths.empty())
+    chksound::bench::BenchmarkReaders(&harness, paths, jobs);
+
+  std::cout << harness.checks() - harness.failures() << " of "
+            << harness.checks() << " checks passed" << std::endl;
+
+  return harness.failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/mp4_writer.h"
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace chksound::bench {
+namespace {
+
+using Bytes = std::vector<unsigned char>;
+
+constexpr int kChannels = 2;
+constexpr int kFramesPerUnit = 1024;
+
+// Syntactic elements of ISO/IEC 14496-3, and the codebook of PNS.
+constexpr uint32_t kIdCpe = 1;
+constexpr uint32_t kIdEnd = 7;
+constexpr uint32_t kNoiseHcb = 13;
+
+// Number of scale factor bands of a long window at 44.1 and 48 kHz.
+constexpr uint32_t kBands = 49;
+
+constexpr uint32_t kGlobalGain = 100;
+
+class BitWriter {
+ public:
+  BitWriter() : bits_{} {}
+
+  void Write(uint32_t value, int bits) {
+    for (auto i = bits - 1; 0 <= i; --i, ++bits_) {
+      if (bits_ % 8 == 0)
+        bytes_.push_back(0);
+      if (value >> i & 1)
+        bytes_.back() |= 0x80 >> bits_ % 8;
+    }
+  }
+
+  // The bits written, padded to a byte.
+  const Bytes& bytes() const {
+    return bytes_;
+  }
+
+ private:
+  Bytes bytes_;
+  size_t bits_;
+
+  BitWriter(const BitWriter&) = delete;
+  BitWriter& operator=(const BitWriter&) = delete;
+};
+
+void Put(Bytes* bytes, uint64_t value, int size) {
+  for (auto i = size - 1; 0 <= i; --i)
+    bytes->push_back(static_cast<unsigned char>(value >> i * 8));
+}
+
+void Put(Bytes* bytes, const Bytes& data) {
+  bytes->insert(bytes->end(), data.begin(), data.end());
+}
+
+Bytes MakeBox(const char (&type)[5], const Bytes& payload) {
+  Bytes box;
+  Put(&box, 8 + payload.size(), 4);
+  box.insert(box.end(), type, type + 4);
+  Put(&box, payload);
+  return box;
+}
+
+Bytes MakeFullBox(const char (&type)[5], uint32_t flags,
+                  const Bytes& payload) {
+  Bytes body;
+  Put(&body, flags, 4);  // version 0.
+  Put(&body, payload);
+  return MakeBox(type, body);
+}
+
+// Descriptor of ISO/IEC 14496-1, shorter than 128 bytes.
+Bytes MakeDescriptor(int tag, const Bytes& payload) {
+  Bytes descriptor{static_cast<unsigned char>(tag),
+                   static_cast<unsigned char>(payload.size())};
+  Put(&descriptor, payload);
+  return descriptor;
+}
+
+// Unity matrix of mvhd and tkhd.
+void PutMatrix(Bytes* bytes) {
+  for (auto value : {0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000})
+    Put(bytes, value, 4);
+}
+
+// A channel pair element of two independent channels whose bands are all
+// noise, then the end of the unit.
+Bytes EncodeUnit(int energy) {
+  BitWriter writer;
+  writer.Write(kIdCpe, 3);
+  writer.Write(0, 4);  // element_instance_tag
+  writer.Write(0, 1);  // common_window
+
+  for (auto i = 0; i < kChannels; ++i) {
+    writer.Write(kGlobalGain, 8);
+
+    // ics_info of a single long window, with no prediction.
+    writer.Write(0, 1);  // ics_reserved_bit
+    writer.Write(0, 2);  // window_sequence: ONLY_LONG_SEQUENCE
+    writer.Write(0, 1);  // window_shape
+    writer.Write(kBands, 6);
+    writer.Write(0, 1);  // predictor_data_present
+
+    // A single section over every band, whose length is coded 5 bits at a
+    // time, 31 meaning more to follow.
+    writer.Write(kNoiseHcb, 4);
+    auto length = kBands;
+    for (; 31 <= length; length -= 31)
+      writer.Write(31, 5);
+    writer.Write(length, 5);
+
+    // The first noise energy is coded in 9 bits relative to global_gain - 90,
+    // the others as differences, 0 being the 1-bit Huffman code "0".
+    writer.Write(energy - (kGlobalGain - 90) + 256, 9);
+    for (uint32_t band = 1; band < kBands; ++band)
+      writer.Write(0, 1);
+
+    writer.Write(0, 1);  // pulse_data_present
+    writer.Write(0, 1);  // tns_data_present
+    writer.Write(0, 1);  // gain_control_data_present
+  }
+
+  writer.Write(kIdEnd, 3);
+  return writer.bytes();
+}
+
+}  // namespace
+
+bool WriteNoiseMp4(const std::filesystem::path& path, int sampling_rate,
+                   int units, int energy) {
+  // AudioSpecificConfig: AAC LC, the index of the sampling rate and the
+  // channel configuration, then GASpecificConfig of 1024 frames per unit.
+  if (sampling_rate != 44100 && sampling_rate != 48000)
+    return false;
+
+  BitWriter config;
+  config.Write(2, 5);
+  config.Write(sampling_rate == 44100 ? 4 : 3, 4);
+  config.Write(kChannels, 4);
+  config.Write(0, 3);
+
+  auto unit = EncodeUnit(energy);
+  uint64_t duration = static_cast<uint64_t>(units) * kFramesPerUnit;
+
+  Bytes ftyp;
+  Put(&ftyp, 0x4D344120, 4);  // M4A
+  Put(&ftyp, 0, 4);
+  Put(&ftyp, 0x4D344120, 4);
+  Put(&ftyp, 0x69736F6D, 4);  // isom
+  ftyp = MakeBox("ftyp", ftyp);
+
+  // The media data precedes the movie, so that its offset is known.
+  Bytes mdat;
+  for (auto i = 0; i < units; ++i)
+    Put(&mdat, unit);
+  mdat = MakeBox("mdat", mdat);
+
+  Bytes mvhd;
+  Put(&mvhd, 0, 8);  // creation_time, modification_time
+  Put(&mvhd, sampling_rate, 4);
+  Put(&mvhd, duration, 4);
+  Put(&mvhd, 0x10000, 4);  // rate
+  Put(&mvhd, 0x100, 2);    // volume
+  Put(&mvhd, 0, 10);
+  PutMatrix(&mvhd);
+  Put(&mvhd, 0, 24);
+  Put(&mvhd, 2, 4);  // next_track_ID
+  mvhd = MakeFullBox("mvhd", 0, mvhd);
+
+  Bytes tkhd;
+  Put(&tkhd, 0, 8);
+  Put(&tkhd, 1, 4);  // track_ID
+  Put(&tkhd, 0, 4);
+  Put(&tkhd, duration, 4);
+  Put(&tkhd, 0, 12);    // reserved, layer, alternate_group
+  Put(&tkhd, 0x100, 2);  // volume
+  Put(&tkhd, 0, 2);
+  PutMatrix(&tkhd);
+  Put(&tkhd, 0, 8);  // width, height
+  tkhd = MakeFullBox("tkhd", 3, tkhd);
+
+  Bytes mdhd;
+  Put(&mdhd, 0, 8);
+  Put(&mdhd, sampling_rate, 4);
+  Put(&mdhd, duration, 4);
+  Put(&mdhd, 0x55C4, 2);  // und
+  Put(&mdhd, 0, 2);
+  mdhd = MakeFullBox("mdhd", 0, mdhd);
+
+  Bytes hdlr;
+  Put(&hdlr, 0, 4);
+  Put(&hdlr, 0x736F756E, 4);  // soun
+  Put(&hdlr, 0, 13);          // reserved, and an empty name.
+  hdlr = MakeFullBox("hdlr", 0, hdlr);
+
+  Bytes dref;
+  Put(&dref, 1, 4);
+  Put(&dref, MakeFullBox("url ", 1, {}));  // in the same file.
+  auto dinf = MakeBox("dinf", MakeFullBox("dref", 0, dref));
+
+  Bytes decoder_config{0x40, 0x15};  // MPEG-4 audio stream.
+  Put(&decoder_config, 0, 3);        // bufferSizeDB
+  Put(&decoder_config, 0, 8);        // maxBitrate, avgBitrate
+  Put(&decoder_config, MakeDescriptor(0x05, config.bytes()));
+
+  Bytes es{0, 1, 0};  // ES_ID and no optional fields.
+  Put(&es, MakeDescriptor(0x04, decoder_config));
+  Put(&es, MakeDescriptor(0x06, {0x02}));
+
+  Bytes mp4a;
+  Put(&mp4a, 0, 6);
+  Put(&mp4a, 1, 2);  // data_reference_index
+  Put(&mp4a, 0, 8);
+  Put(&mp4a, kChannels, 2);
+  Put(&mp4a, 16, 2);  // samplesize
+  Put(&mp4a, 0, 4);
+  Put(&mp4a, static_cast<uint64_t>(sampling_rate) << 16, 4);
+  Put(&mp4a, MakeFullBox("esds", 0, MakeDescriptor(0x03, es)));
+
+  Bytes stsd;
+  Put(&stsd, 1, 4);
+  Put(&stsd, MakeBox("mp4a", mp4a));
+
+  // A single chunk of every unit.
+  Bytes stts;
+  Put(&stts, 1, 4);
+  Put(&stts, units, 4);
+  Put(&stts, kFramesPerUnit, 4);
+
+  Bytes stsc;
+  Put(&stsc, 1, 4);
+  Put(&stsc, 1, 4);
+  Put(&stsc, units, 4);
+  Put(&stsc, 1, 4);
+
+  Bytes stsz;
+  Put(&stsz, unit.size(), 4);
+  Put(&stsz, units, 4);
+
+  Bytes stco;
+  Put(&stco, 1, 4);
+  Put(&stco, ftyp.size() + 8, 4);
+
+  Bytes stbl;
+  Put(&stbl, MakeFullBox("stsd", 0, stsd));
+  Put(&stbl, MakeFullBox("stts", 0, stts));
+  Put(&stbl, MakeFullBox("stsc", 0, stsc));
+  Put(&stbl, MakeFullBox("stsz", 0, stsz));
+  Put(&stbl, MakeFullBox("stco", 0, stco));
+
+  Bytes minf = MakeFullBox("smhd", 0, Bytes(4));
+  Put(&minf, dinf);
+  Put(&minf, MakeBox("stbl", stbl));
+
+  Bytes mdia = mdhd;
+  Put(&mdia, hdlr);
+  Put(&mdia, MakeBox("minf", minf));
+
+  Bytes trak = tkhd;
+  Put(&trak, MakeBox("mdia", mdia));
+
+  Bytes moov = mvhd;
+  Put(&moov, MakeBox("trak", trak));
+  moov = MakeBox("moov", moov);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  for (auto box : {&ftyp, &mdat, &moov})
+    file.write(reinterpret_cast<const char*>(box->data()), box->size());
+
+  return static_cast<bool>(file);
+}
+
+}  // namespace chksound::bench
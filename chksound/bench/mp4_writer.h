@@ -0,0 +1,22 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_MP4_WRITER_H_
+#define CHKSOUND_BENCH_MP4_WRITER_H_
+
+#include <filesystem>
+
+namespace chksound::bench {
+
+// Writes to |path| an MP4 file holding a stereo AAC-LC track of |units|
+// access units of 1024 frames at |sampling_rate|, which is 44100 or 48000.
+// Every scale factor band of every unit is filled by perceptual noise
+// substitution with an energy of 2^(|energy| / 2): PNS needs none of the
+// spectral codebooks, and the decoder scales the noise of each band to that
+// energy exactly, so files differing by 4 in |energy| differ by exactly
+// 6.02 dB once decoded. Returns false if the file cannot be written.
+bool WriteNoiseMp4(const std::filesystem::path& path, int sampling_rate,
+                   int units, int energy);
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_MP4_WRITER_H_
@@ -0,0 +1,69 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_PIPELINE_H_
+#define CHKSOUND_BENCH_PIPELINE_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "bench/corpus.h"
+
+namespace chksound::bench {
+
+// The filters and the 400 ms blocks of GainAnalysis, without anything else,
+// to run the stages of lib1770 on their own.
+class Pipeline {
+ public:
+  // Weighs every channel 1.0 unless |weights| is given.
+  explicit Pipeline(const Signal& signal,
+                    const std::vector<double>& weights = {})
+      : stats_{lib1770_stats_new()},
+        block_{lib1770_block_new(signal.sampling_rate, 400, 4)},
+        pre_{lib1770_pre_new_weights(
+            signal.sampling_rate, signal.channels,
+            weights.empty() ? std::vector<double>(signal.channels, 1.0).data()
+                            : weights.data())} {
+    lib1770_block_add_stats(block_, stats_);
+    lib1770_pre_add_block(pre_, block_);
+  }
+
+  ~Pipeline() {
+    lib1770_pre_close(pre_);
+    lib1770_block_close(block_);
+    lib1770_stats_close(stats_);
+  }
+
+  // Feeds |signal| a frame at a time.
+  void AddSample(const Signal& signal) {
+    lib1770_sample_t sample = {};
+    for (size_t i = 0; i < signal.frames(); ++i) {
+      std::copy_n(&signal.samples[i * signal.channels], signal.channels,
+                  sample);
+      lib1770_pre_add_sample(pre_, sample);
+    }
+  }
+
+  // Feeds |signal| in runs of |frames| frames.
+  void AddSamples(const Signal& signal, size_t frames) {
+    for (size_t i = 0; i < signal.frames(); i += frames) {
+      lib1770_pre_add_samples(pre_, &signal.samples[i * signal.channels],
+                              std::min(frames, signal.frames() - i));
+    }
+  }
+
+  lib1770_stats_t* stats() const {
+    return stats_;
+  }
+
+ private:
+  lib1770_stats_t* const stats_;
+  lib1770_block_t* const block_;
+  lib1770_pre_t* const pre_;
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+};
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_PIPELINE_H_
@@ -0,0 +1,111 @@
+// Copyright (c) 2026 dacci.org
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio/audio_reader.h"
+#include "audio/gain_analysis.h"
+#include "bench/io_stats.h"
+#include "bench/suites.h"
+#include "util/thread_pool.h"
+
+namespace fs = ::std::filesystem;
+
+namespace chksound::bench {
+namespace {
+
+constexpr size_t kFramesPerRead = 4096;
+
+// Decodes |path|, measuring its loudness unless |analyze| is false. Returns
+// the duration decoded in seconds, or a negative value if it cannot be
+// opened.
+double Decode(const fs::path& path, bool analyze) {
+  auto reader = audio::OpenAudio(path);
+  if (reader == nullptr)
+    return -1.0;
+
+  std::unique_ptr<audio::GainAnalysis> analysis;
+  if (analyze) {
+    analysis = std::make_unique<audio::GainAnalysis>(
+        reader->GetSamplingRate(), reader->GetChannelMap(), 0);
+  }
+
+  std::vector<double> buffer(kFramesPerRead * reader->GetChannels());
+  uint64_t frames = 0;
+  while (auto count = reader->Read(buffer.data(), kFramesPerRead)) {
+    if (analysis != nullptr)
+      analysis->Update(buffer.data(), count);
+    frames += count;
+  }
+
+  if (analysis != nullptr)
+    analysis->Finalize(audio::GainAnalysis::Tail::kDrop);
+
+  return frames / reader->GetSamplingRate();
+}
+
+}  // namespace
+
+void BenchmarkReaders(Harness* harness, const std::vector<fs::path>& paths,
+                      size_t threads) {
+  std::vector<fs::path> valid;
+  auto seconds = 0.0;
+  for (auto& path : paths) {
+    auto duration = Decode(path, false);
+    harness->Expect("open " + path.u8string(), 0.0 <= duration);
+    if (duration < 0.0)
+      continue;
+
+    valid.push_back(path);
+    seconds += duration;
+  }
+
+  if (valid.empty())
+    return;
+
+  auto files =
+      std::to_string(valid.size()) + (valid.size() == 1 ? " file" : " files");
+
+  // The files are read into the page cache by now, so that mapping them is
+  // compared with reading them, not with the disk.
+  for (auto memory_map : {true, false}) {
+    audio::SetMemoryMap(memory_map);
+    auto name = "decode " + files + (memory_map ? " mapped" : " buffered");
+    auto decode = [&valid]() {
+      for (auto& path : valid)
+        Decode(path, false);
+    };
+
+    uint64_t before, after;
+    if (GetReadOperations(&before)) {
+      decode();
+      if (GetReadOperations(&after))
+        harness->Print(name, static_cast<double>(after - before), "reads");
+    }
+
+    harness->Measure(name, decode, seconds, "x realtime");
+  }
+  audio::SetMemoryMap(true);
+
+  harness->Measure(
+      "decode and measure " + files,
+      [&valid]() {
+        for (auto& path : valid)
+          Decode(path, true);
+      },
+      seconds, "x realtime");
+
+  util::ThreadPool pool(threads);
+  harness->Measure(
+      "decode and measure " + files + " on " + std::to_string(pool.size()) +
+          " threads",
+      [&valid, &pool]() {
+        for (auto& path : valid)
+          pool.Post([&path]() { Decode(path, true); });
+        pool.Wait();
+      },
+      seconds / pool.size(), "x realtime per thread");
+}
+
+}  // namespace chksound::bench
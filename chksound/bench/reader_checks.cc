@@ -0,0 +1,94 @@
+// Copyright (c) 2026 dacci.org
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "audio/audio_reader.h"
+#include "audio/gain_analysis.h"
+#include "bench/mp4_writer.h"
+#include "bench/suites.h"
+
+namespace fs = ::std::filesystem;
+
+namespace chksound::bench {
+namespace {
+
+constexpr size_t kFramesPerRead = 4096;
+
+// 5 s of AAC at 44.1 kHz.
+constexpr int kUnits = 216;
+
+// Noise energy of the quieter file, and its loudness as ISO/IEC 14496-3
+// defines the synthesis: each band holds 2^(73 / 2) of energy in 16-bit
+// units, which the IMDCT scales by 2 / 2048, K-weighted at the frequencies of
+// the band. The noise is random, so the reference holds to 0.2 dB or so.
+constexpr int kEnergy = 73;
+constexpr double kLoudness = -21.32;
+
+// Decodes an AAC file of noise at |energy| through the platform reader and
+// returns its loudness, or -HUGE_VAL if it cannot be decoded.
+double DecodeNoise(Harness* harness, const fs::path& directory, int energy) {
+  auto name = "AAC noise at " + std::to_string(energy);
+  auto path = directory / ("chksound_bench_" + std::to_string(energy) + ".m4a");
+  if (!WriteNoiseMp4(path, 44100, kUnits, energy)) {
+    harness->Expect("write " + name, false);
+    return -HUGE_VAL;
+  }
+
+  auto reader = audio::OpenAudio(path);
+  harness->Expect("open " + name, reader != nullptr);
+  if (reader == nullptr) {
+    std::error_code error;
+    fs::remove(path, error);
+    return -HUGE_VAL;
+  }
+
+  harness->Expect(name + " format", reader->GetSamplingRate() == 44100.0 &&
+                                        reader->GetChannels() == 2);
+
+  audio::GainAnalysis analysis(reader->GetSamplingRate(),
+                               reader->GetChannelMap(), 0);
+  std::vector<double> buffer(kFramesPerRead * reader->GetChannels());
+  uint64_t frames = 0;
+  while (auto count = reader->Read(buffer.data(), kFramesPerRead)) {
+    analysis.Update(buffer.data(), count);
+    frames += count;
+  }
+  analysis.Finalize(audio::GainAnalysis::Tail::kDrop);
+
+  // Decoders drop up to two units and more of priming, depending on the
+  // platform.
+  harness->Expect(name + " decoded", !reader->HasFailed());
+  harness->ExpectRange(name + " frames", static_cast<double>(frames),
+                       (kUnits - 3) * 1024.0, kUnits * 1024.0);
+
+  reader.reset();
+  std::error_code error;
+  fs::remove(path, error);
+
+  return analysis.Loudness();
+}
+
+}  // namespace
+
+void CheckReaders(Harness* harness) {
+  std::error_code error;
+  auto directory = fs::temp_directory_path(error);
+  if (error) {
+    harness->Expect("temporary directory", false);
+    return;
+  }
+
+  // The decoder draws the same noise for both files, scaled exactly: 4 steps
+  // of noise energy double its amplitude.
+  auto quiet = DecodeNoise(harness, directory, kEnergy);
+  auto loud = DecodeNoise(harness, directory, kEnergy + 4);
+  harness->ExpectNear("AAC noise loudness", quiet, kLoudness, 0.5);
+  harness->ExpectNear("AAC noise 6 dB up", loud - quiet,
+                      20.0 * std::log10(2.0), 0.01);
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,39 @@
+// Copyright (c) 2026 dacci.org
+
+#include "bench/reference.h"
+
+#include <cstdlib>
+
+namespace chksound::bench {
+namespace {
+
+int CompareBin(const void* key, const void* bin) {
+  auto wmsq = *static_cast<const double*>(key);
+  auto entry = static_cast<const lib1770_bin_t*>(bin);
+  if (wmsq < entry->x)
+    return -1;
+  else if (entry->y == 0.0)
+    return 0;
+  else if (entry->y <= wmsq)
+    return 1;
+  else
+    return 0;
+}
+
+}  // namespace
+
+void ReferenceAddSqs(lib1770_stats_t* stats, double wmsq) {
+  if (stats->max.wmsq < wmsq)
+    stats->max.wmsq = wmsq;
+
+  auto bin = static_cast<const lib1770_bin_t*>(
+      bsearch(&wmsq, stats->bin, LIB1770_HIST_NBINS, sizeof(*stats->bin),
+              CompareBin));
+  if (bin != nullptr) {
+    stats->hist.pass1.wmsq += (wmsq - stats->hist.pass1.wmsq) /
+                              static_cast<double>(++stats->hist.pass1.count);
+    ++stats->hist.count[bin - stats->bin];
+  }
+}
+
+}  // namespace chksound::bench
@@ -0,0 +1,18 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_REFERENCE_H_
+#define CHKSOUND_BENCH_REFERENCE_H_
+
+#include "audio/gain_analysis.h"
+
+namespace chksound::bench {
+
+// The implementations which optimized code replaced, as they were, to check
+// the optimized code against them and to time them.
+
+// lib1770_stats_add_sqs() finding the bin of |wmsq| by bsearch().
+void ReferenceAddSqs(lib1770_stats_t* stats, double wmsq);
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_REFERENCE_H_
@@ -0,0 +1,41 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_BENCH_SUITES_H_
+#define CHKSOUND_BENCH_SUITES_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "bench/harness.h"
+
+namespace chksound::bench {
+
+// Checks the loudness measured on the signals of EBU Tech 3341.
+void CheckLoudness(Harness* harness);
+
+// Checks the true peak measured on the signals of EBU Tech 3341.
+void CheckTruePeak(Harness* harness);
+
+// Checks the loudness of AAC files decoded by the platform reader against
+// the level they were encoded at.
+void CheckReaders(Harness* harness);
+
+// Checks the stages of lib1770 against their reference implementations.
+void CheckLib1770(Harness* harness);
+
+// Times the stages of lib1770 on their own.
+void BenchmarkLib1770(Harness* harness);
+
+// Times GainAnalysis as a whole, on |threads| threads at most.
+void BenchmarkAnalysis(Harness* harness, size_t threads);
+
+// Times decoding and measuring |paths| with the platform readers, on
+// |threads| threads.
+void BenchmarkReaders(Harness* harness,
+                      const std::vector<std::filesystem::path>& paths,
+                      size_t threads);
+
+}  // namespace chksound::bench
+
+#endif  // CHKSOUND_BENCH_SUITES_H_
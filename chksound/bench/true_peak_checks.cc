@@ -0,0 +1,91 @@
+// Copyright (c) 2026 dacci.org
+
+#include <cmath>
+#include <string>
+
+#include "audio/true_peak.h"
+#include "bench/corpus.h"
+#include "bench/suites.h"
+
+namespace chksound::bench {
+namespace {
+
+using audio::GainAnalysis;
+using audio::TruePeakMeter;
+
+constexpr double kPi = 3.14159265358979323846;
+
+double ToDecibels(double value) {
+  return 20.0 * std::log10(value);
+}
+
+// Fades |signal| in and out over |seconds| each. The interpolator rings on
+// a sine starting or ending at full amplitude, by 0.7 dB for fs/8.
+void Fade(Signal* signal, double seconds) {
+  auto frames = static_cast<size_t>(seconds * signal->sampling_rate);
+  auto last = signal->frames() - 1;
+  for (size_t i = 0; i < frames; ++i) {
+    auto gain = 0.5 - 0.5 * std::cos(kPi * i / frames);
+    for (int j = 0; j < signal->channels; ++j) {
+      signal->samples[i * signal->channels + j] *= gain;
+      signal->samples[(last - i) * signal->channels + j] *= gain;
+    }
+  }
+}
+
+// Sines whose samples all miss their peaks, as test cases 15 to 19 of EBU
+// Tech 3341 are, whose true peak must be measured within -0.4 and +0.2 dB.
+void CheckInterSamplePeaks(Harness* harness) {
+  struct Case {
+    const char* name;
+    double divisor;  // of the sampling rate giving the frequency.
+    double phase;    // in degrees.
+    double level;
+  };
+
+  const Case cases[] = {
+      {"fs/4 at 45 degrees", 4.0, 45.0, -6.0},
+      {"fs/6 at 60 degrees", 6.0, 60.0, -6.0},
+      {"fs/8 at 67.5 degrees", 8.0, 67.5, -6.0},
+      {"fs/4 at 45 degrees over", 4.0, 45.0, 0.0},
+  };
+
+  for (auto sampling_rate : {48000.0, 44100.0}) {
+    auto suffix = " at " + std::to_string(static_cast<int>(sampling_rate));
+    for (auto& test : cases) {
+      auto sine = Sine(sampling_rate, 2, 1.0, sampling_rate / test.divisor,
+                       test.level, test.phase * kPi / 180.0);
+      Fade(&sine, 0.1);
+      auto measurement = Analyze(sine, GainAnalysis::kTruePeak);
+      harness->ExpectRange(std::string("true peak ") + test.name + suffix,
+                           ToDecibels(measurement.true_peak),
+                           test.level - 0.4, test.level + 0.2);
+      harness->Expect(std::string("sample peak ") + test.name + suffix,
+                      ToDecibels(measurement.peak) < test.level - 0.5);
+    }
+  }
+}
+
+// The history of the interpolator carries over between reads, so reading a
+// signal in pieces measures it as a whole.
+void CheckPieces(Harness* harness) {
+  auto noise = PinkNoise(48000.0, 2, 10.0, -20.0);
+
+  TruePeakMeter meter(noise.channels);
+  meter.Update(noise.samples.data(), noise.frames());
+
+  auto measurement = Analyze(noise, GainAnalysis::kTruePeak);
+  harness->ExpectNear("true peak in pieces", measurement.true_peak,
+                      meter.Peak(), 1e-12);
+  harness->Expect("true peak not below sample peak",
+                  measurement.peak <= measurement.true_peak);
+}
+
+}  // namespace
+
+void CheckTruePeak(Harness* harness) {
+  CheckInterSamplePeaks(harness);
+  CheckPieces(harness);
+}
+
+}  // namespace chksound::bench
@@ -3,79 +3,166 @@
     '../build/common.gypi',
   ],
 
+  'target_defaults': {
+    'include_dirs': [
+      '.',
+      '../third_party/lib1770-2',
+    ],
+
+    'conditions': [
+
+      ['OS=="mac"', {
+        'defines': [
+          'OSATOMIC_USE_INLINED=1',
+        ],
+      }],
+
+      ['OS=="linux"', {
+        'cflags': [
+          '<!@(<(pkg-config) --cflags libmpg123)',
+          '<!@(<(pkg-config) --cflags taglib)',
+        ],
+      }],
+
+      ['OS=="win"', {
+        'msbuild_settings': {
+          'ClCompile': {
+            'DisableSpecificWarnings': [
+              '4245',
+              '4251',
+            ],
+          },
+        },
+      }],
+
+    ],
+  },
+
   'targets': [
     {
-      'target_name': 'chksound',
-      'type': 'executable',
+      # Decoding and measurement, shared by chksound and chksound_bench.
+      'target_name': 'chksound_lib',
+      'type': 'static_library',
 
       'dependencies': [
         '../third_party/lib1770-2/lib1770.gyp:lib1770-2',
       ],
 
-      'include_dirs': [
-        '.',
-        '../third_party/lib1770-2',
-      ],
+      'link_settings': {
+        'conditions': [
 
-      'conditions': [
-
-        ['OS=="mac"', {
-          'defines': [
-            'OSATOMIC_USE_INLINED=1',
-          ],
-          'libraries': [
-            '$(SDKROOT)/System/Library/Frameworks/CoreFoundation.framework',
-            '$(SDKROOT)/System/Library/Frameworks/AudioToolbox.framework',
-            'libtag.dylib',
-          ],
-        }],
-
-        ['OS=="linux"', {
-          'cflags': [
-            '<!@(<(pkg-config) --cflags libmpg123)',
-            '<!@(<(pkg-config) --cflags taglib)',
-          ],
-          'ldflags': [
-            '<!@(<(pkg-config) --libs-only-L --libs-only-other libmpg123)',
-            '<!@(<(pkg-config) --libs-only-L --libs-only-other taglib)',
-          ],
-          'libraries': [
-            '-lstdc++fs',
-            '-lpthread',
-            '<!@(<(pkg-config) --libs-only-l libmpg123)',
-            '<!@(<(pkg-config) --libs-only-l taglib)',
-          ],
-        }],
-
-        ['OS=="win"', {
-          'libraries': [
-            'mfplat.lib',
-            'mfreadwrite.lib',
-            'mfuuid.lib',
-            'ole32.lib',
-            'tag.lib',
-          ],
-          'msbuild_settings': {
-            'ClCompile': {
-              'DisableSpecificWarnings': [
-                '4245',
-                '4251',
-              ],
-            },
-          },
-        }],
+          ['OS=="mac"', {
+            'libraries': [
+              '$(SDKROOT)/System/Library/Frameworks/CoreFoundation.framework',
+              '$(SDKROOT)/System/Library/Frameworks/AudioToolbox.framework',
+              'libtag.dylib',
+            ],
+          }],
 
-      ],
+          ['OS=="linux"', {
+            'ldflags': [
+              '<!@(<(pkg-config) --libs-only-L --libs-only-other libmpg123)',
+              '<!@(<(pkg-config) --libs-only-L --libs-only-other taglib)',
+            ],
+            'libraries': [
+              '-lstdc++fs',
+              '-lpthread',
+              '<!@(<(pkg-config) --libs-only-l libmpg123)',
+              '<!@(<(pkg-config) --libs-only-l taglib)',
+              '-lfaad',
+            ],
+          }],
+
+          ['OS=="win"', {
+            'libraries': [
+              'mfplat.lib',
+              'mfreadwrite.lib',
+              'mfuuid.lib',
+              'ole32.lib',
+              'tag.lib',
+            ],
+          }],
+
+        ],
+      },
 
       'sources': [
-        'app/analyzer.cc',
-        'app/analyzer.h',
-        'app/main.cc',
+        'audio/audio_reader.cc',
         'audio/audio_reader.h',
         'audio/audio_reader_linux.cc',
         'audio/audio_reader_mac.cc',
         'audio/audio_reader_win.cc',
         'audio/gain_analysis.h',
+        'audio/mp4_demuxer.cc',
+        'audio/mp4_demuxer.h',
+        'audio/true_peak.cc',
+        'audio/true_peak.h',
+        'util/json.cc',
+        'util/json.h',
+        'util/profiler.cc',
+        'util/profiler.h',
+        'util/thread_pool.cc',
+        'util/thread_pool.h',
+      ],
+    },
+
+    {
+      'target_name': 'chksound',
+      'type': 'executable',
+
+      'dependencies': [
+        'chksound_lib',
+      ],
+
+      # The initializers are linked into each executable, since nothing refers
+      # to them.
+      'sources': [
+        'app/analysis_cache.cc',
+        'app/analysis_cache.h',
+        'app/analyzer.cc',
+        'app/analyzer.h',
+        'app/main.cc',
+        'app/report.cc',
+        'app/report.h',
+        'util/scoped_initialize.h',
+        'util/scoped_initialize_linux.cc',
+        'util/scoped_initialize_win.cc',
+      ],
+    },
+
+    {
+      # Checks the measurements against reference values and times them, on
+      # signals generated in memory.
+      'target_name': 'chksound_bench',
+      'type': 'executable',
+
+      'dependencies': [
+        'chksound_lib',
+      ],
+
+      'sources': [
+        'bench/analysis_benchmarks.cc',
+        'bench/corpus.cc',
+        'bench/corpus.h',
+        'bench/harness.cc',
+        'bench/harness.h',
+        'bench/io_stats.h',
+        'bench/io_stats_linux.cc',
+        'bench/io_stats_mac.cc',
+        'bench/io_stats_win.cc',
+        'bench/lib1770_benchmarks.cc',
+        'bench/lib1770_checks.cc',
+        'bench/loudness_checks.cc',
+        'bench/main.cc',
+        'bench/mp4_writer.cc',
+        'bench/mp4_writer.h',
+        'bench/pipeline.h',
+        'bench/reader_benchmarks.cc',
+        'bench/reader_checks.cc',
+        'bench/reference.cc',
+        'bench/reference.h',
+        'bench/suites.h',
+        'bench/true_peak_checks.cc',
         'util/scoped_initialize.h',
         'util/scoped_initialize_linux.cc',
         'util/scoped_initialize_win.cc',
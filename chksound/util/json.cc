@@ -0,0 +1,27 @@
+// Copyright (c) 2026 dacci.org
+
+#include "util/json.h"
+
+#include <iomanip>
+
+namespace chksound::util {
+
+void WriteJsonString(std::ostream* stream, const std::string& text) {
+  *stream << '"';
+  for (auto c : text) {
+    auto code = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      *stream << '\\' << c;
+    } else if (c == '\t') {
+      *stream << "\\t";
+    } else if (code < 0x20) {
+      *stream << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+              << static_cast<int>(code) << std::dec << std::setfill(' ');
+    } else {
+      *stream << c;
+    }
+  }
+  *stream << '"';
+}
+
+}  // namespace chksound::util
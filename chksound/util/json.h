@@ -0,0 +1,16 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_UTIL_JSON_H_
+#define CHKSOUND_UTIL_JSON_H_
+
+#include <ostream>
+#include <string>
+
+namespace chksound::util {
+
+// Writes |text|, which is UTF-8, to |stream| as a string literal of JSON.
+void WriteJsonString(std::ostream* stream, const std::string& text);
+
+}  // namespace chksound::util
+
+#endif  // CHKSOUND_UTIL_JSON_H_
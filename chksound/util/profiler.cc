@@ -0,0 +1,124 @@
+// Copyright (c) 2026 dacci.org
+
+#include "util/profiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "util/json.h"
+#include "util/thread_pool.h"
+
+namespace fs = ::std::filesystem;
+
+namespace chksound::util {
+namespace {
+
+constexpr const char* kStageNames[Profiler::kStageCount] = {
+    "scan", "probe", "open", "decode", "filter", "merge", "commit",
+};
+
+}  // namespace
+
+Profiler::Profiler(size_t workers, bool trace)
+    : trace_{trace}, origin_{Clock::now()} {
+  for (size_t i = 0; i <= workers; ++i)
+    slots_.push_back(std::make_unique<Slot>());
+}
+
+void Profiler::Add(Stage stage, Clock::duration time, uint64_t count) {
+  auto slot = GetSlot();
+  slot->time[stage] += time;
+  slot->count[stage] += count;
+}
+
+void Profiler::Add(Stage stage, Clock::time_point start, Clock::time_point end,
+                   const fs::path* file) {
+  auto slot = GetSlot();
+  slot->time[stage] += end - start;
+  ++slot->count[stage];
+
+  if (trace_ && file != nullptr)
+    slot->events.push_back({kStageNames[stage], start, end - start,
+                            file->u8string()});
+}
+
+void Profiler::Trace(const char* name, Clock::time_point start,
+                     Clock::time_point end, const fs::path& file) {
+  if (trace_)
+    GetSlot()->events.push_back({name, start, end - start, file.u8string()});
+}
+
+void Profiler::PrintSummary(std::ostream* stream) const {
+  for (int i = 0; i < kStageCount; ++i) {
+    Clock::duration time{};
+    uint64_t count = 0;
+    for (auto& slot : slots_) {
+      time += slot->time[i];
+      count += slot->count[i];
+    }
+
+    if (count == 0)
+      continue;
+
+    std::chrono::duration<double> total = time;
+    std::chrono::duration<double, std::milli> mean = time / count;
+    *stream << std::left << std::setw(7) << kStageNames[i] << std::right
+            << std::fixed << std::setprecision(3) << std::setw(12)
+            << total.count() << " s " << std::setw(10) << count << " calls "
+            << std::setw(10) << mean.count() << " ms each" << std::endl;
+  }
+}
+
+bool Profiler::WriteTrace(const fs::path& path) const {
+  std::ofstream stream(path, std::ios::trunc);
+  if (!stream) {
+    std::cerr << "failed to open trace: " << path << std::endl;
+    return false;
+  }
+
+  // Timestamps are in microseconds from the construction.
+  stream << "{\"traceEvents\":[" << std::fixed << std::setprecision(3);
+  auto separator = "\n";
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    stream << separator
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+           << ",\"args\":{\"name\":";
+    if (i + 1 < slots_.size())
+      WriteJsonString(&stream, "worker " + std::to_string(i));
+    else
+      WriteJsonString(&stream, "main");
+    stream << "}}";
+    separator = ",\n";
+
+    for (auto& event : slots_[i]->events) {
+      std::chrono::duration<double, std::micro> start =
+          event.start - origin_;
+      std::chrono::duration<double, std::micro> duration = event.duration;
+      stream << separator << "{\"name\":\"" << event.name
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << i
+             << ",\"ts\":" << start.count()
+             << ",\"dur\":" << duration.count() << ",\"args\":{\"file\":";
+      WriteJsonString(&stream, event.file);
+      stream << "}}";
+    }
+  }
+  stream << "\n]}" << std::endl;
+
+  if (!stream) {
+    std::cerr << "failed to write trace: " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+Profiler::Slot* Profiler::GetSlot() {
+  auto index = ThreadPool::CurrentWorker();
+  if (index < 0 || slots_.size() <= static_cast<size_t>(index) + 1)
+    return slots_.back().get();
+
+  return slots_[index].get();
+}
+
+}  // namespace chksound::util
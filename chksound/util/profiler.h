@@ -0,0 +1,110 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_UTIL_PROFILER_H_
+#define CHKSOUND_UTIL_PROFILER_H_
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace chksound::util {
+
+// Accumulates the time spent in each stage of a run, and optionally records
+// the intervals as events of the Trace Event Format of Chrome to see them on
+// a timeline per thread. Each thread of a ThreadPool and the thread outside
+// it write to a slot of their own without locking; the results are read once
+// the pool is idle.
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum Stage {
+    kScan,    // listing of the files
+    kProbe,   // reading of the tags
+    kOpen,    // opening of the decoder
+    kDecode,
+    kFilter,  // K-weighting, gating and peak measurement
+    kMerge,   // aggregation of the results
+    kCommit,  // writing of the tags
+    kStageCount,
+  };
+
+  // Adds the time from its construction to its destruction to |stage|, and
+  // records it as an event about |file| if it is not null.
+  class Scope {
+   public:
+    Scope(Profiler* profiler, Stage stage,
+          const std::filesystem::path* file = nullptr)
+        : profiler_{profiler}, stage_{stage}, file_{file} {
+      if (profiler_ != nullptr)
+        start_ = Clock::now();
+    }
+
+    ~Scope() {
+      if (profiler_ != nullptr)
+        profiler_->Add(stage_, start_, Clock::now(), file_);
+    }
+
+   private:
+    Profiler* const profiler_;
+    const Stage stage_;
+    const std::filesystem::path* const file_;
+    Clock::time_point start_;
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+  // Records the events only if |trace| is true.
+  Profiler(size_t workers, bool trace);
+
+  // Adds |time| spent in |count| intervals of |stage| without an event.
+  void Add(Stage stage, Clock::duration time, uint64_t count = 1);
+
+  // Adds the interval from |start| to |end| to |stage|, and records it as an
+  // event about |file| if it is not null.
+  void Add(Stage stage, Clock::time_point start, Clock::time_point end,
+           const std::filesystem::path* file);
+
+  // Records the interval from |start| to |end| as an event named |name| about
+  // |file|, without adding it to a stage.
+  void Trace(const char* name, Clock::time_point start, Clock::time_point end,
+             const std::filesystem::path& file);
+
+  // Prints the total and the mean time of each stage.
+  void PrintSummary(std::ostream* stream) const;
+
+  bool WriteTrace(const std::filesystem::path& path) const;
+
+ private:
+  struct Event {
+    const char* name;
+    Clock::time_point start;
+    Clock::duration duration;
+    std::string file;
+  };
+
+  // Aligned so that the threads do not share a cache line.
+  struct alignas(64) Slot {
+    Clock::duration time[kStageCount];
+    uint64_t count[kStageCount];
+    std::vector<Event> events;
+  };
+
+  Slot* GetSlot();
+
+  const bool trace_;
+  const Clock::time_point origin_;
+  std::vector<std::unique_ptr<Slot>> slots_;  // the thread outside comes last.
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+};
+
+}  // namespace chksound::util
+
+#endif  // CHKSOUND_UTIL_PROFILER_H_
@@ -0,0 +1,134 @@
+// Copyright (c) 2026 dacci.org
+
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace chksound::util {
+namespace {
+
+thread_local int current_worker = -1;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads)
+    : pending_{}, queued_{}, stopped_{}, busy_time_{} {
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+  for (size_t i = 0; i < threads; ++i)
+    workers_.push_back(std::make_unique<Worker>());
+
+  for (size_t i = 0; i < threads; ++i)
+    workers_[i]->thread = std::thread(&ThreadPool::Run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  posted_.notify_all();
+
+  for (auto& worker : workers_)
+    worker->thread.join();
+}
+
+void ThreadPool::Post(std::function<void()> task) {
+  auto index = current_worker;
+  auto local = 0 <= index && static_cast<size_t>(index) < workers_.size();
+
+  // A task is queued and counted under the same locks, so that no worker sees
+  // it counted before it can be taken, or takes it before it is counted.
+  if (local) {
+    auto& worker = *workers_[index];
+    std::scoped_lock<std::mutex, std::mutex> lock(worker.mutex, mutex_);
+    worker.tasks.push_back(std::move(task));
+    ++pending_;
+    ++queued_;
+  } else {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    ++pending_;
+    ++queued_;
+  }
+
+  posted_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+int ThreadPool::CurrentWorker() {
+  return current_worker;
+}
+
+void ThreadPool::Run(size_t index) {
+  current_worker = static_cast<int>(index);
+
+  for (std::function<void()> task;;) {
+    if (!Take(index, &task)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      posted_.wait(lock, [this]() { return stopped_ || 0 < queued_; });
+      if (stopped_)
+        return;
+
+      continue;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    task();
+    task = nullptr;
+    busy_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+    std::scoped_lock<std::mutex> lock(mutex_);
+    if (--pending_ == 0)
+      idle_.notify_all();
+  }
+}
+
+bool ThreadPool::Take(size_t index, std::function<void()>* task) {
+  // Tasks posted by this worker itself come first, newest first.
+  {
+    auto& worker = *workers_[index];
+    std::scoped_lock<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty()) {
+      *task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+
+  // Then the tasks posted from outside, in order.
+  {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    if (!tasks_.empty()) {
+      *task = std::move(tasks_.front());
+      tasks_.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+
+  // Finally steal the oldest task of another worker.
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    auto& victim = *workers_[(index + i) % workers_.size()];
+    std::scoped_lock<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace chksound::util
@@ -0,0 +1,74 @@
+// Copyright (c) 2026 dacci.org
+
+#ifndef CHKSOUND_UTIL_THREAD_POOL_H_
+#define CHKSOUND_UTIL_THREAD_POOL_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+namespace chksound::util {
+
+// Fixed set of worker threads. Tasks posted from outside the pool are run in
+// the order they were posted; tasks posted by a worker go to the worker's own
+// queue and are run before anything else, and idle workers steal them from
+// busy ones.
+class ThreadPool {
+ public:
+  // Uses as many threads as there are hardware threads if |threads| is 0.
+  explicit ThreadPool(size_t threads);
+  ~ThreadPool();
+
+  void Post(std::function<void()> task);
+
+  // Blocks until every posted task has been run.
+  void Wait();
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  // Total time the workers have spent running tasks.
+  std::chrono::nanoseconds busy_time() const {
+    return std::chrono::nanoseconds(busy_time_);
+  }
+
+  // Returns the index of the calling worker, or -1 if the calling thread does
+  // not belong to a pool.
+  static int CurrentWorker();
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+    std::thread thread;
+  };
+
+  void Run(size_t index);
+  bool Take(size_t index, std::function<void()>* task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable posted_;
+  std::condition_variable idle_;
+  std::deque<std::function<void()>> tasks_;
+  size_t pending_;  // posted but not finished yet.
+  std::atomic<size_t> queued_;  // posted but not started yet.
+  bool stopped_;
+
+  std::atomic<int64_t> busy_time_;
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+};
+
+}  // namespace chksound::util
+
+#endif  // CHKSOUND_UTIL_THREAD_POOL_H_
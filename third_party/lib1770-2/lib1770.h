@@ -52,12 +52,8 @@ extern "C" {
 ///////////////////////////////////////////////////////////////////////////////
 #define LIB1770_BUF_SIZE      9
 #define LIB1770_LFE           3
-#if defined (LIB1770_LFE) // [
-#define LIB1770_MAX_CHANNELS  6
-#define LIB1770_SAMPLES_SIZE  8
-#else // ] [
-#define LIB1770_MAX_CHANNELS  5
-#endif // ]
+// e.g. 22.2; a multiple of 4 (the avx2 lanes).
+#define LIB1770_MAX_CHANNELS  24
 #if defined __GNUC__ // [
 #define LIB1770_DEPRECATED __attribute__ ((deprecated))
 #else // ] [
@@ -90,12 +86,9 @@ extern "C" {
   ((size)*sizeof(((lib1770_block_t *)NULL)->ring.wmsq[0]))
 
 ///////////////////////////////////////////////////////////////////////////////
-#if defined (LIB1770_LFE) // [
-typedef double lib1770_sample_t[LIB1770_SAMPLES_SIZE];
-#else // ] [
 typedef double lib1770_sample_t[LIB1770_MAX_CHANNELS];
-#endif // ]
 typedef unsigned long long lib1770_count_t;
+typedef unsigned int lib1770_bin_count_t;
 
 typedef struct lib1770_biquad lib1770_biquad_t;
 typedef struct lib1770_biquad_ps lib1770_biquad_ps_t;
@@ -129,7 +122,6 @@ struct lib1770_bin {
   double db;
   double x;
   double y;
-  lib1770_count_t count;
 };
 
 #define LIB1770_HIST_MIN      (-70)
@@ -140,6 +132,7 @@ struct lib1770_bin {
 
 struct lib1770_stats {
   lib1770_stats_t *next;
+  const lib1770_bin_t *bin;   // shared by all the statistics.
 
   struct {
     double wmsq;
@@ -152,18 +145,13 @@ struct lib1770_stats {
     } pass1;
 
 #if 0 // [
-    lib1770_bin_t bin[0];
+    lib1770_bin_count_t count[0];
 #else // ] [
-    lib1770_bin_t bin[1];
+    lib1770_bin_count_t count[1];   // one per bin.
 #endif // ]
   } hist;
 };
 
-#if ! defined (LIB1770_HIST_NBINS) // [
-int lib1770_stats_create(lib1770_stats_t *stats);
-void lib1770_stats_destroy(lib1770_stats_t *stats);
-#endif // ]
-
 lib1770_stats_t *lib1770_stats_new(void);
 void lib1770_stats_close(lib1770_stats_t *stats);
 
@@ -196,11 +184,11 @@ struct lib1770_block {
   double scale;         // depends on block size, i.e. on samplerate
 
   struct {
-    size_t size;        // number of blocks in ring buffer.
-    size_t used;        // number of blocks used in ring buffer.
-    size_t count;       // number of samples processed in front block.
-    size_t offs;        // offset of front block.
-    double wmsq[0];     // allocated blocks.
+    size_t size;        // number of partitions in ring buffer.
+    size_t used;        // number of partitions used in ring buffer.
+    size_t count;       // number of samples processed in front partition.
+    size_t offs;        // offset of front partition.
+    double wmsq[0];     // allocated partitions.
   } ring;
 };
 
@@ -221,6 +209,12 @@ struct lib1770_pre {
   int lfe;
 #endif // ]
 
+  // the channel layout is resolved once: the lanes are the channels taking
+  // part in the measurement, i.e. all but those weighted 0 like the lfe.
+  int lanes;
+  int map[LIB1770_MAX_CHANNELS];    // interleaved channel of each lane.
+  double g[LIB1770_MAX_CHANNELS];   // weight of each lane.
+
   lib1770_biquad_t f1;
   lib1770_biquad_t f2;
 
@@ -238,10 +232,19 @@ lib1770_pre_t *lib1770_pre_new(double samplerate, int channels)
 #else // ] [
 lib1770_pre_t *lib1770_pre_new(double samplerate, int channels);
 #endif // ]
+// "weights" holds the weight of each of the "channels" interleaved channels,
+// e.g. 1.41 for the surround channels and 0.0 for the lfe.
+lib1770_pre_t *lib1770_pre_new_weights(double samplerate, int channels,
+    const double *weights);
 void lib1770_pre_close(lib1770_pre_t *pre);
 
 void lib1770_pre_add_block(lib1770_pre_t *pre, lib1770_block_t *block);
 void lib1770_pre_add_sample(lib1770_pre_t *pre, lib1770_sample_t sample);
+// feeds "frames" interleaved frames of "channels" samples each.
+void lib1770_pre_add_samples(lib1770_pre_t *pre, const double *samples,
+    size_t frames);
+void lib1770_pre_prime(lib1770_pre_t *pre, const double *samples,
+    size_t frames);
 void lib1770_pre_flush(lib1770_pre_t *pre);
 
 #ifdef __cplusplus
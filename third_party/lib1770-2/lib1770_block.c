@@ -65,20 +65,15 @@ void lib1770_block_add_stats(lib1770_block_t *block, lib1770_stats_t *stats)
   block->stats=stats;
 }
 
+// the ring holds the sums of the partitions, so that a sample is added once
+// whatever the partition, and a block is summed from them when it completes.
 void lib1770_block_add_sqs(lib1770_block_t *block, double wssqs)
 {
   double *wmsq=block->ring.wmsq;
   lib1770_stats_t *stats;
 
-  if (1.0e-15<=wssqs) {
-    double *wp=wmsq;
-    double *mp=wp+block->ring.used;
-
-    wssqs*=block->scale;
-
-    while (wp<mp)
-      (*wp++)+=wssqs;
-  }
+  if (1.0e-15<=wssqs)
+    wmsq[block->ring.offs]+=wssqs*block->scale;
 
   if (++block->ring.count==block->overlap_size) {
     size_t next_offs=block->ring.offs+1;
@@ -87,7 +82,11 @@ void lib1770_block_add_sqs(lib1770_block_t *block, double wssqs)
       next_offs=0;
 
     if (block->ring.used==block->ring.size) {
-      double prev_wmsq=wmsq[next_offs];
+      double prev_wmsq=0.0;
+      size_t i;
+
+      for (i=0;i<block->ring.size;++i)
+        prev_wmsq+=wmsq[i];
 
       if (block->gate<prev_wmsq) {
         for (stats=block->stats;NULL!=stats;stats=stats->next)
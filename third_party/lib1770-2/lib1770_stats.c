@@ -19,70 +19,77 @@
  */
 #include <lib1770.h>
 
-#if ! defined (LIB1770_HIST_NBINS) // [
-int lib1770_stats_create(lib1770_stats_t *stats)
-{
-  double step=1.0/LIB1770_HIST_GRAIN;
-  lib1770_bin_t *wp,*mp;
-
-#if 0 // [
-  stats=LIB1770_CALLOC(1,(sizeof *stats)
-      +LIB1770_HIST_NBINS*(sizeof stats->hist.bin[0]));
-  LIB1770_GOTO(NULL==stats,"allocating bs.1770 statistics",stats);
+#if defined (_WIN32) // [
+#include <windows.h>
+#else // ] [
+#include <pthread.h>
 #endif // ]
 
 ///////////////////////////////////////////////////////////////////////////////
-  stats->max.wmsq=LIB1770_SILENCE_GATE;
+// the bin table is immutable and hence shared by all the statistics, which
+// only carry the per-bin counts.
+static lib1770_bin_t lib1770_bin[LIB1770_HIST_NBINS];
 
-///////////////////////////////////////////////////////////////////////////////
-  stats->hist.pass1.wmsq=0.0;
-  stats->hist.pass1.count=0;
-
-  wp=stats->hist.bin;
-  mp=wp+LIB1770_HIST_NBINS;
+static void lib1770_bin_init(void)
+{
+  double step=1.0/LIB1770_HIST_GRAIN;
+  lib1770_bin_t *wp=lib1770_bin;
+  lib1770_bin_t *mp=wp+LIB1770_HIST_NBINS;
 
   while (wp<mp) {
-    size_t i=wp-stats->hist.bin;
+    size_t i=wp-lib1770_bin;
     double db=step*i+LIB1770_HIST_MIN;
     double wsmq=pow(10.0,0.1*(0.691+db));
 
     wp->db=db;
     wp->x=wsmq;
     wp->y=0.0;
-    wp->count=0;
 
     if (0<i)
       wp[-1].y=wsmq;
 
     ++wp;
   }
-
-  return 0;
-#if 0 // [
-stats:
-  return NULL;
-#endif // ]
 }
 
-void lib1770_stats_destroy(lib1770_stats_t *stats)
+#if defined (_WIN32) // [
+static BOOL CALLBACK lib1770_bin_init_once(PINIT_ONCE once, PVOID param,
+    PVOID *context)
 {
-  (void)stats;
+  (void)once;
+  (void)param;
+  (void)context;
+  lib1770_bin_init();
+
+  return TRUE;
 }
 #endif // ]
 
+static const lib1770_bin_t *lib1770_bin_get(void)
+{
+#if defined (_WIN32) // [
+  static INIT_ONCE once=INIT_ONCE_STATIC_INIT;
+
+  InitOnceExecuteOnce(&once,lib1770_bin_init_once,NULL,NULL);
+#else // ] [
+  static pthread_once_t once=PTHREAD_ONCE_INIT;
+
+  pthread_once(&once,lib1770_bin_init);
+#endif // ]
+
+  return lib1770_bin;
+}
+
 lib1770_stats_t *lib1770_stats_new(void)
 {
   lib1770_stats_t *stats;
-#if defined (LIB1770_HIST_NBINS) // [
-  double step=1.0/LIB1770_HIST_GRAIN;
-  lib1770_bin_t *wp,*mp;
-#endif // ]
 
   stats=LIB1770_CALLOC(1,(sizeof *stats)
-      +LIB1770_HIST_NBINS*(sizeof stats->hist.bin[0]));
+      +LIB1770_HIST_NBINS*(sizeof stats->hist.count[0]));
   LIB1770_GOTO(NULL==stats,"allocating bs.1770 statistics",stats);
 
-#if defined (LIB1770_HIST_NBINS) // [
+  stats->bin=lib1770_bin_get();
+
 ///////////////////////////////////////////////////////////////////////////////
   stats->max.wmsq=LIB1770_SILENCE_GATE;
 
@@ -90,43 +97,13 @@ lib1770_stats_t *lib1770_stats_new(void)
   stats->hist.pass1.wmsq=0.0;
   stats->hist.pass1.count=0;
 
-  wp=stats->hist.bin;
-  mp=wp+LIB1770_HIST_NBINS;
-
-  while (wp<mp) {
-    size_t i=wp-stats->hist.bin;
-    double db=step*i+LIB1770_HIST_MIN;
-    double wsmq=pow(10.0,0.1*(0.691+db));
-
-    wp->db=db;
-    wp->x=wsmq;
-    wp->y=0.0;
-    wp->count=0;
-
-    if (0<i)
-      wp[-1].y=wsmq;
-
-    ++wp;
-  }
-
-  return stats;
-#else // ] [
-  if (lib1770_stats_create(stats)<0)
-    goto create;
-
   return stats;
-create:
-  LIB1770_FREE(stats);
-#endif // ]
 stats:
   return NULL;
 }
 
 void lib1770_stats_close(lib1770_stats_t *stats)
 {
-#if ! defined (LIB1770_HIST_NBINS) // [
-  lib1770_stats_destroy(stats);
-#endif // ]
   LIB1770_FREE(stats);
 }
 
@@ -147,10 +124,10 @@ void lib1770_stats_merge(lib1770_stats_t *lhs, lib1770_stats_t *rhs)
   lib1770_count_t count;
   double q1,q2;
 #if defined (LIB1770_STATS_MERGE_FIX) // [
-  lib1770_bin_t *bin1,*mp;
-  const lib1770_bin_t *bin2;
+  lib1770_bin_count_t *count1,*mp;
+  const lib1770_bin_count_t *count2;
 #else // ] [
-  lib1770_bin_t *bin1,*bin2,*mp;
+  lib1770_bin_count_t *count1,*count2,*mp;
 #endif // ]
 
   if (lhs->max.wmsq<rhs->max.wmsq)
@@ -165,40 +142,55 @@ void lib1770_stats_merge(lib1770_stats_t *lhs, lib1770_stats_t *rhs)
     lhs->hist.pass1.count=count;
 #endif // ]
     lhs->hist.pass1.wmsq=q1*lhs->hist.pass1.wmsq+q2*rhs->hist.pass1.wmsq;
-    bin1=lhs->hist.bin;
-    bin2=rhs->hist.bin;
-    mp=bin1+LIB1770_HIST_NBINS;
+    count1=lhs->hist.count;
+    count2=rhs->hist.count;
+    mp=count1+LIB1770_HIST_NBINS;
 
-    while (bin1<mp)
-      (bin1++)->count+=(bin2++)->count;
+    while (count1<mp)
+      (*count1++)+=(*count2++);
   }
 }
 
-static int lib1770_bin_cmp(const void *key, const void *bin)
+static long lib1770_stats_get_bin(const lib1770_stats_t *stats, double wmsq)
 {
-  if (*(const double *)key<((const lib1770_bin_t *)bin)->x)
+  const lib1770_bin_t *bin=stats->bin;
+  long i;
+
+  // below the lowest bin (or not a number).
+  if (!(bin[0].x<=wmsq))
     return -1;
-  else if (0==((const lib1770_bin_t *)bin)->y)
-    return 0;
-  else if (((const lib1770_bin_t *)bin)->y<=*(const double *)key)
-    return 1;
-  else
-    return 0;
+
+  // the bins are spaced uniformly in dB, hence the index is computed
+  // directly rather than searched for.
+  i=(long)floor(LIB1770_HIST_GRAIN*(LIB1770_LUFS(wmsq)-LIB1770_HIST_MIN));
+
+  if (i<0)
+    i=0;
+  else if (LIB1770_HIST_NBINS-1<i)
+    i=LIB1770_HIST_NBINS-1;
+
+  // correct rounding errors at the bin edges.
+  while (0<i&&wmsq<bin[i].x)
+    --i;
+
+  while (i<LIB1770_HIST_NBINS-1&&bin[i].y<=wmsq)
+    ++i;
+
+  return i;
 }
 
 void lib1770_stats_add_sqs(lib1770_stats_t *stats, double wmsq)
 {
-  lib1770_bin_t *bin;
+  long bin;
 
 ///////////////////////////////////////////////////////////////////////////////
   if (stats->max.wmsq<wmsq)
     stats->max.wmsq=wmsq;
 
 ///////////////////////////////////////////////////////////////////////////////
-  bin=bsearch(&wmsq,stats->hist.bin,LIB1770_HIST_NBINS,
-      sizeof stats->hist.bin[0],lib1770_bin_cmp);
+  bin=lib1770_stats_get_bin(stats,wmsq);
 
-  if (NULL!=bin) {
+  if (0<=bin) {
     // cumulative moving average.
     // https://en.wikipedia.org/wiki/Moving_average#Cumulative_moving_average
 #if 1 // {
@@ -221,7 +213,7 @@ void lib1770_stats_add_sqs(lib1770_stats_t *stats, double wmsq)
     stats->hist.pass1.wmsq+=wmsq/m;
 	++stats->hist.pass1.count;
 #endif // }
-    ++bin->count;
+    ++stats->hist.count[bin];
   }
 }
 
@@ -235,20 +227,23 @@ double lib1770_stats_get_max(lib1770_stats_t *stats)
 double lib1770_stats_get_mean(lib1770_stats_t *stats, double gate)
 {
   const lib1770_bin_t *rp,*mp;
+  const lib1770_bin_count_t *cp;
   double wmsq=0.0;
   lib1770_count_t count=0ull;
 
-  rp=stats->hist.bin;
+  rp=stats->bin;
   mp=rp+LIB1770_HIST_NBINS;
+  cp=stats->hist.count;
   gate=stats->hist.pass1.wmsq*pow(10,0.1*gate);
 
   while (rp<mp) {
-    if (0ull<rp->count&&gate<rp->x) {
-      wmsq+=(double)rp->count*rp->x;
-      count+=rp->count;
+    if (0u<*cp&&gate<rp->x) {
+      wmsq+=(double)*cp*rp->x;
+      count+=*cp;
     }
 
     ++rp;
+    ++cp;
   }
 
   return LIB1770_LUFS_HIST(count,wmsq,LIB1770_SILENCE);
@@ -258,17 +253,20 @@ double lib1770_stats_get_range(lib1770_stats_t *stats, double gate,
     double lower, double upper)
 {
   const lib1770_bin_t *rp,*mp;
+  const lib1770_bin_count_t *cp;
   lib1770_count_t count=0ull;
 
-  rp=stats->hist.bin;
+  rp=stats->bin;
   mp=rp+LIB1770_HIST_NBINS;
+  cp=stats->hist.count;
   gate=stats->hist.pass1.wmsq*pow(10,0.1*gate);
 
   while (rp<mp) {
-    if (0ull<rp->count&&gate<rp->x)
-      count+=rp->count;
+    if (0u<*cp&&gate<rp->x)
+      count+=*cp;
 
     ++rp;
+    ++cp;
   }
 
   if (lower>upper) {
@@ -291,12 +289,13 @@ double lib1770_stats_get_range(lib1770_stats_t *stats, double gate,
     double min=0.0;
     double max=0.0;
 
-    rp=stats->hist.bin;
+    rp=stats->bin;
+    cp=stats->hist.count;
     count=0ull;
 
     while (rp<mp) {
       if (gate<rp->x) {
-        count+=rp->count;
+        count+=*cp;
 
         if (prev_count<lower_count&&lower_count<=count)
           min=rp->db;
@@ -310,6 +309,7 @@ double lib1770_stats_get_range(lib1770_stats_t *stats, double gate,
       }
 
       ++rp;
+      ++cp;
     }
 
     return max-min;